@@ -0,0 +1,504 @@
+#include <fcntl.h>    // open(), posix_fadvise()
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h> // fstat()
+#include <unistd.h>   // pread(), pwrite(), close()
+#include "sort_typed.h"
+#include "util.h"
+
+MERGE_SORT_DEFINE(sort_i32, int32_t, SORT_LESS)
+MERGE_SORT_DEFINE(sort_i64, int64_t, SORT_LESS)
+
+#define MIN_MERGE_BUF  (((size_t) 1) << 16) // per run, keeps merge reads large
+#define MIN_MEM        (4*MIN_MERGE_BUF)
+
+typedef struct {
+  off_t start;  // byte offset in the run file
+  size_t n;     // elements
+} ext_run_t;
+
+/* START: I/O helpers */
+// pread()/pwrite() of exactly len bytes, returns 1 on error or EOF
+static int read_full(int fd, void *buf, size_t len, off_t off)
+{
+  char *p = (char *) buf;
+  ssize_t got;
+
+  while (len > 0) {
+    if ((got = pread(fd, p, len, off)) <= 0) return 1;
+    p += got;
+    off += got;
+    len -= (size_t) got;
+  }
+
+  return 0;
+}
+
+static int write_full(int fd, const void *buf, size_t len, off_t off)
+{
+  const char *p = (const char *) buf;
+  ssize_t put;
+
+  while (len > 0) {
+    if ((put = pwrite(fd, p, len, off)) <= 0) return 1;
+    p += put;
+    off += put;
+    len -= (size_t) put;
+  }
+
+  return 0;
+}
+
+// Anonymous temporary file in dir, removed when closed
+static int open_tmp(const char *dir)
+{
+  char path[4096];
+  int fd;
+
+  if (snprintf(path, sizeof(path), "%s/ext_sort_XXXXXX", dir) >= (int) sizeof(path)) return -1;
+  if ((fd = mkstemp(path)) < 0) return -1;
+  unlink(path);
+
+  return fd;
+}
+
+static void sort_chunk(void *buf, size_t n, void *tmp, size_t elem_size)
+{
+  if (elem_size == sizeof(int32_t)) sort_i32_buf((int32_t *) buf, (int32_t *) tmp, n);
+  else sort_i64_buf((int64_t *) buf, (int64_t *) tmp, n);
+}
+/* END: I/O helpers */
+
+/* START: Run formation */
+typedef struct {
+  int in_fd, run_fd;
+  char *buf;
+  size_t w_len, r_len;  // bytes, 0 for none
+  off_t w_off, r_off;
+  int err;
+} io_job_t;
+
+// Writes out the previous sorted chunk, then reads the next chunk
+// into the same buffer
+static void *io_job(void *arg)
+{
+  io_job_t *job = (io_job_t *) arg;
+
+  job->err = 0;
+  if (job->w_len > 0) job->err |= write_full(job->run_fd, job->buf, job->w_len, job->w_off);
+  if (job->r_len > 0) job->err |= read_full(job->in_fd, job->buf, job->r_len, job->r_off);
+
+  return NULL;
+}
+
+/* Cuts the input into chunks of chunk_bytes, sorts each one and
+   writes it to run_fd at its offset in the input, so run i starts
+   at i*chunk_bytes. Two chunk buffers alternate: while one is
+   sorted, an I/O thread writes the other (the previous run) and
+   reads the next chunk into it, so sorting overlaps with I/O.
+*/
+static int form_runs(int in_fd, int run_fd, size_t n, size_t elem_size,
+                     char *mem, size_t chunk_bytes, ext_run_t *runs, size_t n_runs)
+{
+  char *bufs[2] = { mem, &mem[chunk_bytes] };
+  char *scratch = &mem[2*chunk_bytes];
+  size_t chunk = chunk_bytes/elem_size;
+  io_job_t job;
+  pthread_t thread;
+  int threaded;
+
+  for (size_t i = ((size_t) 0); i < n_runs; ++i) {
+    runs[i].start = (off_t) (i*chunk*elem_size);
+    runs[i].n = n - i*chunk < chunk ? n - i*chunk : chunk;
+  }
+
+  if (read_full(in_fd, bufs[0], runs[0].n*elem_size, 0)) return 1;
+
+  for (size_t i = ((size_t) 0); i < n_runs; ++i) {
+    job.in_fd = in_fd;
+    job.run_fd = run_fd;
+    job.buf = bufs[(i+1) % 2];
+    job.w_len = i > 0 ? runs[i-1].n*elem_size : 0;
+    job.w_off = i > 0 ? runs[i-1].start : 0;
+    job.r_len = i + 1 < n_runs ? runs[i+1].n*elem_size : 0;
+    job.r_off = i + 1 < n_runs ? runs[i+1].start : 0;
+
+    threaded = pthread_create(&thread, NULL, io_job, &job) == 0;
+    sort_chunk(bufs[i % 2], runs[i].n, scratch, elem_size);
+    if (threaded) pthread_join(thread, NULL);
+    else io_job(&job);
+    if (job.err) return 1;
+  }
+
+  return write_full(run_fd, bufs[(n_runs-1) % 2], runs[n_runs-1].n*elem_size,
+                    runs[n_runs-1].start);
+}
+/* END: Run formation */
+
+/* START: k-way merge */
+typedef struct {
+  off_t off;      // next byte to read from the run file
+  size_t left;    // elements of the run not yet read
+  char *buf;
+  size_t pos, len;
+} ext_cursor_t;
+
+typedef struct {
+  size_t k;
+  size_t *node;   // node[0] the winner, node[1..k) the losers
+  int64_t *key;   // current head of each run
+  char *done;     // run exhausted
+} loser_tree_t;
+
+// Run a beats run b: exhausted runs lose, ties go to the lower run
+static inline int beats(const loser_tree_t *lt, size_t a, size_t b)
+{
+  if (lt->done[a]) return 0;
+  if (lt->done[b]) return 1;
+
+  return lt->key[a] < lt->key[b] || (lt->key[a] == lt->key[b] && a < b);
+}
+
+/* Tournament of k runs with the leaves at k..2k-1 of an implicit
+   binary tree, each inner node keeping the loser of its match.
+   win is scratch of 2k entries.
+*/
+static void loser_tree_build(loser_tree_t *lt, size_t *win)
+{
+  size_t k = lt->k;
+
+  for (size_t i = ((size_t) 0); i < k; ++i) win[k+i] = i;
+  for (size_t j = k-1; j >= 1; --j) {
+    size_t a = win[2*j], b = win[2*j+1];
+
+    win[j] = beats(lt, a, b) ? a : b;
+    lt->node[j] = beats(lt, a, b) ? b : a;
+  }
+  lt->node[0] = k > 1 ? win[1] : 0;
+}
+
+// The winner's head changed: replay its matches up to the root,
+// log2(k) comparisons
+static inline void loser_tree_replay(loser_tree_t *lt)
+{
+  size_t w = lt->node[0], t;
+
+  for (size_t j = (lt->k + w)/2; j >= 1; j /= 2) {
+    if (beats(lt, lt->node[j], w)) {
+      t = lt->node[j];
+      lt->node[j] = w;
+      w = t;
+    }
+  }
+  lt->node[0] = w;
+}
+
+static inline int64_t head_key(const ext_cursor_t *c, size_t elem_size)
+{
+  if (elem_size == sizeof(int32_t)) return ((const int32_t *) c->buf)[c->pos];
+  return ((const int64_t *) c->buf)[c->pos];
+}
+
+static int cursor_fill(ext_cursor_t *c, int fd, size_t cap, size_t elem_size)
+{
+  size_t m = c->left < cap ? c->left : cap;
+
+  if (read_full(fd, c->buf, m*elem_size, c->off)) return 1;
+  c->off += (off_t) (m*elem_size);
+  c->left -= m;
+  c->pos = 0;
+  c->len = m;
+
+  return 0;
+}
+
+/* Merges the k sorted runs of src_fd into one run written to dst_fd
+   at dst_off. mem is split into k+1 equal buffers, one per run and
+   one for the output, so every read and write is a large sequential
+   transfer.
+*/
+static int merge_runs(int src_fd, const ext_run_t *runs, size_t k, int dst_fd, off_t dst_off,
+                      size_t elem_size, char *mem, size_t mem_bytes)
+{
+  size_t cap = mem_bytes/(k+1)/elem_size;
+  char *out = &mem[k*cap*elem_size];
+  size_t n_out = 0, w;
+  ext_cursor_t *cur = (ext_cursor_t *) malloc(k*sizeof(ext_cursor_t));
+  size_t *win = (size_t *) malloc(2*k*sizeof(size_t));
+  loser_tree_t lt;
+  int err = 0;
+
+  lt.k = k;
+  lt.node = (size_t *) malloc(k*sizeof(size_t));
+  lt.key = (int64_t *) malloc(k*sizeof(int64_t));
+  lt.done = (char *) malloc(k);
+  if (cur == NULL || win == NULL || lt.node == NULL || lt.key == NULL || lt.done == NULL) {
+    err = 1;
+    goto out;
+  }
+
+  for (size_t i = ((size_t) 0); i < k; ++i) {
+    cur[i].off = runs[i].start;
+    cur[i].left = runs[i].n;
+    cur[i].buf = &mem[i*cap*elem_size];
+    if ((err = cursor_fill(&cur[i], src_fd, cap, elem_size))) goto out;
+    lt.done[i] = cur[i].len == 0;
+    lt.key[i] = lt.done[i] ? 0 : head_key(&cur[i], elem_size);
+  }
+  loser_tree_build(&lt, win);
+
+  while (!lt.done[w = lt.node[0]]) {
+    memcpy(&out[n_out*elem_size], &cur[w].buf[cur[w].pos*elem_size], elem_size);
+    if (++n_out == cap) {
+      if ((err = write_full(dst_fd, out, n_out*elem_size, dst_off))) goto out;
+      dst_off += (off_t) (n_out*elem_size);
+      n_out = 0;
+    }
+
+    if (++cur[w].pos == cur[w].len) {
+      if (cur[w].left > 0) {
+        if ((err = cursor_fill(&cur[w], src_fd, cap, elem_size))) goto out;
+      } else {
+        lt.done[w] = 1;
+      }
+    }
+    if (!lt.done[w]) lt.key[w] = head_key(&cur[w], elem_size);
+    loser_tree_replay(&lt);
+  }
+  err = write_full(dst_fd, out, n_out*elem_size, dst_off);
+
+out:
+  free(cur);
+  free(win);
+  free(lt.node);
+  free(lt.key);
+  free(lt.done);
+
+  return err;
+}
+/* END: k-way merge */
+
+/* External merge sort of the int32 (elem_size 4) or int64 (elem_size
+   8) native endian integers of in_fd into out_fd, using at most about
+   mem_bytes of buffers (raised to MIN_MEM if smaller) and temporary
+   files in tmp_dir (/tmp if NULL).
+
+   Runs of mem_bytes/3 are sorted in memory with the typed merge sort
+   and spilled to a temporary file, sorting overlapping with the I/O
+   (see form_runs()). They are then merged by a loser tree with
+   mem_bytes split into per run buffers; if that would leave less
+   than MIN_MERGE_BUF per run, groups of runs are first merged into
+   longer runs in another temporary file, pass by pass.
+
+   Returns 0 on success, 1 on error (allocation, I/O, or an input
+   size that is not a multiple of elem_size).
+*/
+int ext_sort_fd(int in_fd, int out_fd, size_t elem_size, size_t mem_bytes, const char *tmp_dir)
+{
+  struct stat st;
+  size_t n, chunk_bytes, n_runs, fan_in, n_next;
+  ext_run_t *runs = NULL, *next = NULL, *swp;
+  char *mem = NULL;
+  int run_fd = -1, next_fd = -1, err = 1;
+
+  if (elem_size != sizeof(int32_t) && elem_size != sizeof(int64_t)) return 1;
+  if (tmp_dir == NULL) tmp_dir = "/tmp";
+  if (mem_bytes < MIN_MEM) mem_bytes = MIN_MEM;
+  if (fstat(in_fd, &st) || st.st_size % (off_t) elem_size) return 1;
+
+  n = (size_t) st.st_size/elem_size;
+  if (ftruncate(out_fd, 0)) return 1;
+  if (n == 0) return 0;
+
+  chunk_bytes = mem_bytes/3/elem_size*elem_size;
+  n_runs = (n*elem_size + chunk_bytes - 1)/chunk_bytes;
+  fan_in = mem_bytes/MIN_MERGE_BUF - 1;
+
+#ifdef POSIX_FADV_SEQUENTIAL
+  posix_fadvise(in_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+  mem = (char *) malloc(mem_bytes);
+  runs = (ext_run_t *) malloc(n_runs*sizeof(ext_run_t));
+  next = (ext_run_t *) malloc(n_runs*sizeof(ext_run_t));
+  if (mem == NULL || runs == NULL || next == NULL) goto out;
+
+  // A single run is sorted straight into the output
+  if (n_runs == 1) {
+    if (read_full(in_fd, mem, n*elem_size, 0)) goto out;
+    sort_chunk(mem, n, &mem[chunk_bytes], elem_size);
+    err = write_full(out_fd, mem, n*elem_size, 0);
+    goto out;
+  }
+
+  if ((run_fd = open_tmp(tmp_dir)) < 0) goto out;
+  if (form_runs(in_fd, run_fd, n, elem_size, mem, chunk_bytes, runs, n_runs)) goto out;
+
+  while (n_runs > fan_in) {
+    off_t off = 0;
+
+    if ((next_fd = open_tmp(tmp_dir)) < 0) goto out;
+    n_next = 0;
+    for (size_t i = ((size_t) 0); i < n_runs; i += fan_in) {
+      size_t k = n_runs - i < fan_in ? n_runs - i : fan_in;
+
+      next[n_next].start = off;
+      next[n_next].n = 0;
+      for (size_t j = i; j < i + k; ++j) next[n_next].n += runs[j].n;
+      if (merge_runs(run_fd, &runs[i], k, next_fd, off, elem_size, mem, mem_bytes)) goto out;
+      off += (off_t) (next[n_next++].n*elem_size);
+    }
+
+    close(run_fd);
+    run_fd = next_fd;
+    next_fd = -1;
+    swp = runs;
+    runs = next;
+    next = swp;
+    n_runs = n_next;
+  }
+
+  err = merge_runs(run_fd, runs, n_runs, out_fd, 0, elem_size, mem, mem_bytes);
+
+out:
+  if (run_fd >= 0) close(run_fd);
+  if (next_fd >= 0) close(next_fd);
+  free(mem);
+  free(runs);
+  free(next);
+
+  return err;
+}
+
+int ext_sort_file(const char *in_path, const char *out_path, size_t elem_size,
+                  size_t mem_bytes, const char *tmp_dir)
+{
+  int in_fd, out_fd, err;
+
+  if ((in_fd = open(in_path, O_RDONLY)) < 0) return 1;
+  if ((out_fd = open(out_path, O_WRONLY | O_CREAT, 0644)) < 0) {
+    close(in_fd);
+    return 1;
+  }
+
+  err = ext_sort_fd(in_fd, out_fd, elem_size, mem_bytes, tmp_dir);
+  close(in_fd);
+  err |= close(out_fd) != 0;
+
+  return err;
+}
+
+/* START: Tests */
+// Writes n random elements to a temporary file, sorts it with the
+// given budget and checks the output is ordered and has the same
+// elements (count, sum and xor)
+static int check_ext_sort(size_t n, size_t elem_size, size_t mem_bytes, double *secs)
+{
+  const size_t block = ((size_t) 1) << 16;
+  char *buf = (char *) malloc(block*sizeof(int64_t));
+  uint64_t sum_in = 0, xor_in = 0, sum_out = 0, xor_out = 0, v;
+  int64_t prev = INT64_MIN, key;
+  int in_fd = open_tmp("/tmp"), out_fd = open_tmp("/tmp");
+  int pass = 1;
+  double t;
+
+  if (buf == NULL || in_fd < 0 || out_fd < 0) {
+    pass = -1;
+    goto out;
+  }
+
+  for (size_t i = ((size_t) 0); i < n; i += block) {
+    size_t m = n - i < block ? n - i : block;
+
+    for (size_t j = ((size_t) 0); j < m; ++j) {
+      v = ((uint64_t) rand() << 33) ^ ((uint64_t) rand() << 11) ^ (uint64_t) rand();
+      if (elem_size == sizeof(int32_t)) {
+        ((int32_t *) buf)[j] = (int32_t) v;
+        v = (uint64_t) (int64_t) (int32_t) v;
+      } else {
+        ((int64_t *) buf)[j] = (int64_t) v;
+      }
+      sum_in += v;
+      xor_in ^= v;
+    }
+    if (write_full(in_fd, buf, m*elem_size, (off_t) (i*elem_size))) {
+      pass = -1;
+      goto out;
+    }
+  }
+
+  t = wall_time();
+  if (ext_sort_fd(in_fd, out_fd, elem_size, mem_bytes, NULL)) {
+    pass = -1;
+    goto out;
+  }
+  *secs = wall_time() - t;
+
+  for (size_t i = ((size_t) 0); i < n; i += block) {
+    size_t m = n - i < block ? n - i : block;
+
+    if (read_full(out_fd, buf, m*elem_size, (off_t) (i*elem_size))) {
+      pass = 0;
+      goto out;
+    }
+    for (size_t j = ((size_t) 0); j < m; ++j) {
+      key = elem_size == sizeof(int32_t) ? ((int32_t *) buf)[j] : ((int64_t *) buf)[j];
+      pass &= prev <= key;
+      prev = key;
+      sum_out += (uint64_t) key;
+      xor_out ^= (uint64_t) key;
+    }
+  }
+  pass &= sum_in == sum_out && xor_in == xor_out;
+  pass &= lseek(out_fd, 0, SEEK_END) == (off_t) (n*elem_size);
+
+out:
+  free(buf);
+  if (in_fd >= 0) close(in_fd);
+  if (out_fd >= 0) close(out_fd);
+
+  return pass;
+}
+/* END: Tests */
+
+int main(int argc, char **argv)
+{
+  const size_t sizes[] = { 0, 1, 1000, 100000, 3000000 };
+  const size_t mems[] = { MIN_MEM, ((size_t) 1) << 22, ((size_t) 1) << 28 };
+  const size_t elem_sizes[] = { sizeof(int32_t), sizeof(int64_t) };
+  double secs = 0.0;
+  int res;
+
+  // ext_sort in out [elem size] [memory MiB] [temporary directory]
+  if (argc >= 3) {
+    size_t elem_size = argc > 3 ? (size_t) atol(argv[3]) : sizeof(int32_t);
+    size_t mem_bytes = (argc > 4 ? (size_t) atol(argv[4]) : 1024) << 20;
+
+    if (ext_sort_file(argv[1], argv[2], elem_size, mem_bytes, argc > 5 ? argv[5] : NULL)) {
+      printf("Error while sorting %s\n", argv[1]);
+      return 1;
+    }
+    return 0;
+  }
+
+  for (size_t e = 0; e < sizeof(elem_sizes)/sizeof(elem_sizes[0]); ++e) {
+    for (size_t m = 0; m < sizeof(mems)/sizeof(mems[0]); ++m) {
+      int n_pass = 0;
+
+      for (size_t s = 0; s < sizeof(sizes)/sizeof(sizes[0]); ++s) {
+        if ((res = check_ext_sort(sizes[s], elem_sizes[e], mems[m], &secs)) < 0) {
+          printf("Error while executing external sort:(\n");
+          return 1;
+        }
+        n_pass += res;
+      }
+
+      printf("%d/%zu external sort pass for int%zu, %zu KiB budget (%zu numbers in %.1f ms)\n",
+             n_pass, sizeof(sizes)/sizeof(sizes[0]), 8*elem_sizes[e], mems[m] >> 10,
+             sizes[sizeof(sizes)/sizeof(sizes[0]) - 1], secs*1e3);
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,58 @@
+#ifndef __FOLD_H__
+#define __FOLD_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Typed folds without function pointers.
+
+   FOLD_DEFINE(name, type, op, seed) defines
+
+     static inline type name(const type *arr, size_t n);
+
+   which returns seed op arr[0] op ... op arr[n-1]. op is a macro
+   taking two arguments (FOLD_ADD, FOLD_MUL, FOLD_MIN, FOLD_MAX or
+   your own), it is expanded inline so there is no indirect call.
+
+   The array is folded into FOLD_LANES independent accumulators, so
+   there is no loop carried dependency and the compiler vectorizes
+   and unrolls the main loop, even for float and double.
+
+   op must be associative and commutative and seed must be its
+   identity (0 for +, 1 for *, the largest value for min, ...),
+   since every lane starts from seed.
+*/
+
+#define FOLD_LANES 16
+
+#define FOLD_ADD(a, b) ((a) + (b))
+#define FOLD_MUL(a, b) ((a) * (b))
+#define FOLD_MIN(a, b) ((a) < (b) ? (a) : (b))
+#define FOLD_MAX(a, b) ((a) > (b) ? (a) : (b))
+
+#define FOLD_DEFINE(name, type, op, seed)                       \
+static inline type name(const type *arr, size_t n)              \
+{                                                               \
+  type acc[FOLD_LANES];                                         \
+  type res;                                                     \
+  size_t n_lanes = n - n%FOLD_LANES;                            \
+  size_t i, j;                                                  \
+                                                                \
+  for (j = ((size_t) 0); j < FOLD_LANES; ++j)                   \
+    acc[j] = (seed);                                            \
+                                                                \
+  for (i = ((size_t) 0); i < n_lanes; i += FOLD_LANES)          \
+    for (j = ((size_t) 0); j < FOLD_LANES; ++j)                 \
+      acc[j] = op(acc[j], arr[i+j]);                            \
+                                                                \
+  for (; i < n; ++i)                                            \
+    acc[0] = op(acc[0], arr[i]);                                \
+                                                                \
+  res = acc[0];                                                 \
+  for (j = ((size_t) 1); j < FOLD_LANES; ++j)                   \
+    res = op(res, acc[j]);                                      \
+                                                                \
+  return res;                                                   \
+}
+
+#endif
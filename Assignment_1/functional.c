@@ -1,5 +1,11 @@
+#include <fcntl.h>    // posix_fadvise()
+#include <float.h>
 #include <limits.h>
 #include <stdio.h>
+#include <sys/mman.h> // mmap(), munmap(), madvise()
+#include <sys/stat.h> // fstat()
+#include <unistd.h>   // write(), close()
+#include "fold.h"
 #include "util.h"
 
 int add(int a, int b)
@@ -28,14 +34,556 @@ int fold(int *arr, size_t n, int seed, int (*fun_ptr)(int, int))
   return (*fun_ptr)(*arr, fold(&arr[1], n-1, seed, fun_ptr));
 }
 
+/* Same result as fold() but with a loop instead of one stack frame
+   per element, so it works for any n and any fun_ptr.
+*/
+int fold_iter(const int *arr, size_t n, int seed, int (*fun_ptr)(int, int))
+{
+  int acc = seed;
+
+  while (n > 0) {
+    --n;
+    acc = (*fun_ptr)(arr[n], acc);
+  }
+
+  return acc;
+}
+
+/* START: Parallel tree fold */
+#define FOLD_MIN_CHUNK  ((size_t) 1 << 16)
+
+// Wrapping versions of the built-ins so the lane kernels have no UB
+#define LANE_ADD(a, b) ((int) ((unsigned) (a) + (unsigned) (b)))
+#define LANE_MUL(a, b) ((int) ((unsigned) (a) * (unsigned) (b)))
+
+FOLD_DEFINE(fold_lanes_add, int, LANE_ADD, 0)
+FOLD_DEFINE(fold_lanes_multiply, int, LANE_MUL, 1)
+FOLD_DEFINE(fold_lanes_min, int, FOLD_MIN, INT_MAX)
+FOLD_DEFINE(fold_lanes_max, int, FOLD_MAX, INT_MIN)
+
+typedef int (*lane_kernel_t)(const int *, size_t);
+
+static lane_kernel_t get_lane_kernel(int (*fun_ptr)(int, int))
+{
+  if (fun_ptr == add) return fold_lanes_add;
+  if (fun_ptr == multiply) return fold_lanes_multiply;
+  if (fun_ptr == min_val) return fold_lanes_min;
+  if (fun_ptr == max_val) return fold_lanes_max;
+  return NULL;
+}
+
+typedef struct {
+  const int *arr;
+  size_t n;
+  int (*fun_ptr)(int, int);
+  lane_kernel_t kernel;
+  int res;
+} fold_job_t;
+
+static void *fold_job(void *arg)
+{
+  fold_job_t *job = (fold_job_t *) arg;
+
+  if (job->kernel != NULL) {
+    job->res = job->kernel(job->arr, job->n);
+    return NULL;
+  }
+
+  // Generic associative operator: keep the element order
+  job->res = job->arr[0];
+  for (size_t i = ((size_t) 1); i < job->n; ++i)
+    job->res = (*job->fun_ptr)(job->res, job->arr[i]);
+
+  return NULL;
+}
+
+/* Folds arr with an associative fun_ptr by splitting it into one
+   chunk per thread and combining the partial results in a
+   balanced tree, left to right, so the answer equals fold().
+   The built-in add, multiply, min_val and max_val use the lane
+   kernels above.
+
+   Non-associative operators must use fold() or fold_iter().
+*/
+int fold_tree(const int *arr, size_t n, int seed, int (*fun_ptr)(int, int), size_t n_threads)
+{
+  fold_job_t *jobs;
+  lane_kernel_t kernel;
+  size_t max_threads, step, i;
+  int res;
+
+  if (n == 0) return seed;
+
+  max_threads = (n + FOLD_MIN_CHUNK - 1)/FOLD_MIN_CHUNK;
+  if (n_threads > max_threads) n_threads = max_threads;
+  if (n_threads == 0) n_threads = 1;
+
+  if ((jobs = (fold_job_t *) malloc(n_threads*sizeof(fold_job_t))) == NULL)
+    return fold_iter(arr, n, seed, fun_ptr);
+
+  kernel = get_lane_kernel(fun_ptr);
+  for (i = ((size_t) 0); i < n_threads; ++i) {
+    size_t lo = n*i/n_threads;
+    size_t hi = n*(i+1)/n_threads;
+
+    jobs[i].arr = &arr[lo];
+    jobs[i].n = hi - lo;
+    jobs[i].fun_ptr = fun_ptr;
+    jobs[i].kernel = kernel;
+  }
+
+  parallel_run(fold_job, jobs, sizeof(fold_job_t), n_threads);
+
+  // Combine neighbours pairwise: 0+1, 2+3, ... then 0+2, 4+6, ...
+  for (step = ((size_t) 1); step < n_threads; step *= 2)
+    for (i = ((size_t) 0); i + step < n_threads; i += 2*step)
+      jobs[i].res = (*fun_ptr)(jobs[i].res, jobs[i+step].res);
+
+  res = (*fun_ptr)(jobs[0].res, seed);
+  free(jobs);
+
+  return res;
+}
+
+/* Drop-in replacement for fold(). The built-in operators are known
+   to be associative and go through fold_tree() on all processors,
+   anything else falls back to the sequential fold_iter().
+*/
+int fold_parallel(const int *arr, size_t n, int seed, int (*fun_ptr)(int, int))
+{
+  if (get_lane_kernel(fun_ptr) == NULL) return fold_iter(arr, n, seed, fun_ptr);
+  return fold_tree(arr, n, seed, fun_ptr, n_cpus());
+}
+/* END: Parallel tree fold */
+
+/* START: Fused multi-aggregate fold */
+#define FOLD_BLOCK ((size_t) 4096)
+
+typedef struct {
+  int seed;
+  int (*fun_ptr)(int, int);
+} fold_op_t;
+
+/* Computes res[j] = fold(arr, n, ops[j].seed, ops[j].fun_ptr) for
+   the m operators in a single pass over arr.
+
+   The array is walked from the end in blocks of FOLD_BLOCK ints
+   (16 KiB, fits in L1), and every operator consumes the block
+   while it is still in cache. Walking backwards keeps the right
+   fold order of fold(), so any operator is allowed; the built-ins
+   reduce each block with their lane kernel.
+*/
+void fold_many(const int *arr, size_t n, const fold_op_t *ops, int *res, size_t m)
+{
+  size_t lo, hi;
+  lane_kernel_t kernel;
+
+  for (size_t j = ((size_t) 0); j < m; ++j)
+    res[j] = ops[j].seed;
+
+  for (hi = n; hi > 0; hi = lo) {
+    lo = (hi-1) & ~(FOLD_BLOCK-1);
+
+    for (size_t j = ((size_t) 0); j < m; ++j) {
+      if ((kernel = get_lane_kernel(ops[j].fun_ptr)) != NULL)
+        res[j] = (*ops[j].fun_ptr)(kernel(&arr[lo], hi-lo), res[j]);
+      else
+        res[j] = fold_iter(&arr[lo], hi-lo, res[j], ops[j].fun_ptr);
+    }
+  }
+}
+/* END: Fused multi-aggregate fold */
+
+/* START: Parallel prefix scan */
+typedef void (*scan_kernel_t)(int *, const int *, size_t, int, int);
+
+/* Scans n elements starting from acc, writing acc op arr[0] op ...
+   op arr[i] to out[i] (or the value before arr[i] when exclusive).
+   out may alias arr, each element is read before it is written.
+*/
+#define DEFINE_SCAN_KERNEL(name, OP)                                  \
+static void name(int *out, const int *arr, size_t n, int acc, int exclusive) \
+{                                                                     \
+  int val;                                                            \
+                                                                      \
+  if (exclusive) {                                                    \
+    for (size_t i = ((size_t) 0); i < n; ++i) {                       \
+      val = arr[i];                                                   \
+      out[i] = acc;                                                   \
+      acc = OP(acc, val);                                             \
+    }                                                                 \
+  } else {                                                            \
+    for (size_t i = ((size_t) 0); i < n; ++i)                         \
+      out[i] = acc = OP(acc, arr[i]);                                 \
+  }                                                                   \
+}
+
+DEFINE_SCAN_KERNEL(scan_add, LANE_ADD)
+DEFINE_SCAN_KERNEL(scan_multiply, LANE_MUL)
+DEFINE_SCAN_KERNEL(scan_min, FOLD_MIN)
+DEFINE_SCAN_KERNEL(scan_max, FOLD_MAX)
+
+static scan_kernel_t get_scan_kernel(int (*fun_ptr)(int, int))
+{
+  if (fun_ptr == add) return scan_add;
+  if (fun_ptr == multiply) return scan_multiply;
+  if (fun_ptr == min_val) return scan_min;
+  if (fun_ptr == max_val) return scan_max;
+  return NULL;
+}
+
+typedef struct {
+  int *out;
+  const int *arr;
+  size_t n;
+  int (*fun_ptr)(int, int);
+  int exclusive;
+  int offset;
+} scan_job_t;
+
+static void *scan_job(void *arg)
+{
+  scan_job_t *job = (scan_job_t *) arg;
+  scan_kernel_t kernel = get_scan_kernel(job->fun_ptr);
+  int acc = job->offset;
+  int val;
+
+  if (kernel != NULL) {
+    kernel(job->out, job->arr, job->n, acc, job->exclusive);
+    return NULL;
+  }
+
+  for (size_t i = ((size_t) 0); i < job->n; ++i) {
+    val = job->arr[i];
+    if (job->exclusive) job->out[i] = acc;
+    acc = (*job->fun_ptr)(acc, val);
+    if (!job->exclusive) job->out[i] = acc;
+  }
+
+  return NULL;
+}
+
+/* Writes the prefix scan of arr, starting from seed, to out:
+   out[i] = seed op arr[0] op ... op arr[i] for an inclusive scan,
+   out[i] = seed op arr[0] op ... op arr[i-1] for an exclusive one.
+   out may be arr itself. fun_ptr must be associative.
+
+   Work efficient scan in three phases (about 2n operations):
+   every thread reduces its chunk with fold_job(), the chunk
+   totals are scanned sequentially to get each chunk's starting
+   value, then every thread scans its chunk from that value. The
+   built-ins use inlined kernels in both passes.
+*/
+void scan_parallel(int *out, const int *arr, size_t n, int seed,
+  int (*fun_ptr)(int, int), int exclusive, size_t n_threads)
+{
+  fold_job_t *totals = NULL;
+  scan_job_t *jobs;
+  size_t max_threads;
+
+  if (n == 0) return;
+
+  max_threads = (n + FOLD_MIN_CHUNK - 1)/FOLD_MIN_CHUNK;
+  if (n_threads > max_threads) n_threads = max_threads;
+
+  if (n_threads > 1) {
+    jobs = (scan_job_t *) malloc(n_threads*sizeof(scan_job_t));
+    totals = (fold_job_t *) malloc(n_threads*sizeof(fold_job_t));
+    if (jobs == NULL || totals == NULL) {
+      free(jobs);
+      free(totals);
+      n_threads = 1;
+    }
+  }
+
+  if (n_threads <= 1) {
+    scan_job_t job = {out, arr, n, fun_ptr, exclusive, seed};
+    scan_job(&job);
+    return;
+  }
+
+  for (size_t i = ((size_t) 0); i < n_threads; ++i) {
+    size_t lo = n*i/n_threads;
+    size_t hi = n*(i+1)/n_threads;
+
+    totals[i].arr = &arr[lo];
+    totals[i].n = hi - lo;
+    totals[i].fun_ptr = fun_ptr;
+    totals[i].kernel = get_lane_kernel(fun_ptr);
+
+    jobs[i].out = &out[lo];
+    jobs[i].arr = &arr[lo];
+    jobs[i].n = hi - lo;
+    jobs[i].fun_ptr = fun_ptr;
+    jobs[i].exclusive = exclusive;
+  }
+
+  // Phase 1: chunk totals
+  parallel_run(fold_job, totals, sizeof(fold_job_t), n_threads);
+
+  // Phase 2: exclusive scan of the totals gives each chunk its offset
+  jobs[0].offset = seed;
+  for (size_t i = ((size_t) 1); i < n_threads; ++i)
+    jobs[i].offset = (*fun_ptr)(jobs[i-1].offset, totals[i-1].res);
+
+  // Phase 3: scan every chunk from its offset
+  parallel_run(scan_job, jobs, sizeof(scan_job_t), n_threads);
+
+  free(totals);
+  free(jobs);
+}
+
+void scan_inclusive(int *out, const int *arr, size_t n, int seed, int (*fun_ptr)(int, int))
+{
+  scan_parallel(out, arr, n, seed, fun_ptr, 0, n_cpus());
+}
+
+void scan_exclusive(int *out, const int *arr, size_t n, int seed, int (*fun_ptr)(int, int))
+{
+  scan_parallel(out, arr, n, seed, fun_ptr, 1, n_cpus());
+}
+
+/* Checks scan_parallel() against a sequential loop calling fun_ptr.
+
+   Returns 1 if they agree, 0 otherwise.
+*/
+static int check_scan(const int *arr, size_t n, int seed, int (*fun_ptr)(int, int),
+  int exclusive, size_t n_threads)
+{
+  int *out;
+  int acc = seed;
+  int same_ans = 1;
+
+  if ((out = (int *) malloc(n*sizeof(int))) == NULL) return 0;
+
+  scan_parallel(out, arr, n, seed, fun_ptr, exclusive, n_threads);
+
+  for (size_t i = ((size_t) 0); i < n && same_ans; ++i) {
+    if (exclusive) same_ans = (out[i] == acc);
+    acc = (*fun_ptr)(acc, arr[i]);
+    if (!exclusive) same_ans = (out[i] == acc);
+  }
+
+  free(out);
+
+  return same_ans;
+}
+/* END: Parallel prefix scan */
+
+/* START: Streaming file fold */
+#define FOLD_FILE_WINDOW (((size_t) 64) << 20)
+
+/* Folds a file of raw native endian int32 values with the m
+   operators, like fold_many() on its contents.
+
+   The file is mapped one FOLD_FILE_WINDOW at a time, starting from
+   the end so the right fold of fold() composes: each window is
+   folded with fold_many() using the results of the windows after
+   it as seeds. Each window is unmapped once folded and the kernel
+   is asked to read the next one ahead, so the memory used stays
+   constant whatever the size of the file. fold_many() walks each
+   window backwards too, so the kernel's forward readahead is turned
+   off (MADV_RANDOM) and the whole window is requested up front
+   (MADV_WILLNEED) instead.
+
+   Returns 0 on success, 1 if the file cannot be read or its size
+   is not a multiple of sizeof(int).
+*/
+int fold_fd(int fd, const fold_op_t *ops, int *res, size_t m)
+{
+  struct stat st;
+  fold_op_t *win_ops;
+  size_t size, lo, hi;
+  void *map;
+
+  if (fstat(fd, &st) != 0) return 1;
+  size = (size_t) st.st_size;
+  if (size % sizeof(int) != 0) return 1;
+  if (m == 0) return 0;
+
+  if ((win_ops = (fold_op_t *) malloc(m*sizeof(fold_op_t))) == NULL) return 1;
+
+  for (size_t j = ((size_t) 0); j < m; ++j) {
+    win_ops[j] = ops[j];
+    res[j] = ops[j].seed;
+  }
+
+#ifdef POSIX_FADV_WILLNEED
+  // Start reading the last window, the first one folded
+  if (size > 0) {
+    lo = (size-1) & ~(FOLD_FILE_WINDOW-1);
+    posix_fadvise(fd, (off_t) lo, (off_t) (size-lo), POSIX_FADV_WILLNEED);
+  }
+#endif
+
+  for (hi = size; hi > 0; hi = lo) {
+    lo = (hi-1) & ~(FOLD_FILE_WINDOW-1);
+
+#ifdef POSIX_FADV_WILLNEED
+    // Start reading the window we will need after this one (no-op on macOS)
+    if (lo > 0)
+      posix_fadvise(fd, (off_t) (lo - FOLD_FILE_WINDOW), (off_t) FOLD_FILE_WINDOW, POSIX_FADV_WILLNEED);
+#endif
+
+    map = mmap(NULL, hi-lo, PROT_READ, MAP_PRIVATE, fd, (off_t) lo);
+    if (map == MAP_FAILED) {
+      free(win_ops);
+      return 1;
+    }
+    madvise(map, hi-lo, MADV_RANDOM);
+    madvise(map, hi-lo, MADV_WILLNEED);
+
+    fold_many((const int *) map, (hi-lo)/sizeof(int), win_ops, res, m);
+    for (size_t j = ((size_t) 0); j < m; ++j)
+      win_ops[j].seed = res[j];
+
+    munmap(map, hi-lo);
+  }
+
+  free(win_ops);
+
+  return 0;
+}
+
+int fold_file(const char *path, const fold_op_t *ops, int *res, size_t m)
+{
+  int fd, ret;
+
+  if ((fd = open(path, O_RDONLY)) < 0) return 1;
+  ret = fold_fd(fd, ops, res, m);
+  close(fd);
+
+  return ret;
+}
+
+/* Writes n ints to a new unlinked temporary file.
+
+   Returns its file descriptor, or -1 on error.
+*/
+static int write_tmp_file(const int *arr, size_t n)
+{
+  char path[] = "/tmp/fold_XXXXXX";
+  const char *buf = (const char *) arr;
+  size_t left = n*sizeof(int);
+  ssize_t written;
+  int fd;
+
+  if ((fd = mkstemp(path)) < 0) return -1;
+  unlink(path);
+
+  while (left > 0) {
+    if ((written = write(fd, buf, left)) <= 0) {
+      close(fd);
+      return -1;
+    }
+    buf += written;
+    left -= (size_t) written;
+  }
+
+  return fd;
+}
+/* END: Streaming file fold */
+
+/* START: Typed fold benchmark */
+#define BENCH_SIZE  (((size_t) 1) << 22)
+#define BENCH_REPS  5
+
+FOLD_DEFINE(fold_i32_add, int32_t, LANE_ADD, 0)
+FOLD_DEFINE(fold_i64_add, int64_t, FOLD_ADD, 0)
+FOLD_DEFINE(fold_f32_add, float, FOLD_ADD, 0.0f)
+FOLD_DEFINE(fold_f64_add, double, FOLD_ADD, 0.0)
+
+FOLD_DEFINE(fold_i32_max, int32_t, FOLD_MAX, INT32_MIN)
+FOLD_DEFINE(fold_i64_max, int64_t, FOLD_MAX, INT64_MIN)
+FOLD_DEFINE(fold_f32_max, float, FOLD_MAX, -FLT_MAX)
+FOLD_DEFINE(fold_f64_max, double, FOLD_MAX, -DBL_MAX)
+
+// Keeps the compiler from dropping the timed calls
+static volatile double bench_sink;
+
+// Best time of BENCH_REPS runs of expr, in ns per element
+#define BENCH_NS(best, n, expr)                         \
+  do {                                                  \
+    best = 1e30;                                        \
+    for (int rep_ = 0; rep_ < BENCH_REPS; ++rep_) {     \
+      double t_ = wall_time();                          \
+      bench_sink = (double) (expr);                     \
+      t_ = (wall_time() - t_)*1e9/((double) (n));       \
+      if (t_ < best) best = t_;                         \
+    }                                                   \
+  } while (0)
+
+/* Compares fold_iter() going through the add and max_val function
+   pointers against the FOLD_DEFINE kernels for each element type.
+*/
+static int bench_folds(const int *arr, size_t n)
+{
+  int64_t *arr64;
+  float *arr_f;
+  double *arr_d;
+  double t_add, t_max;
+
+  arr64 = (int64_t *) malloc(n*sizeof(int64_t));
+  arr_f = (float *) malloc(n*sizeof(float));
+  arr_d = (double *) malloc(n*sizeof(double));
+  if (arr64 == NULL || arr_f == NULL || arr_d == NULL) {
+    free(arr64);
+    free(arr_f);
+    free(arr_d);
+    return 1;
+  }
+
+  for (size_t i = ((size_t) 0); i < n; ++i) {
+    arr64[i] = (int64_t) arr[i];
+    arr_f[i] = (float) arr[i];
+    arr_d[i] = (double) arr[i];
+  }
+
+  printf("\nFold benchmark on %zu numbers, ns per element (best of %d)\n", n, BENCH_REPS);
+  printf("%-20s %8s %8s\n", "", "add", "max");
+
+  BENCH_NS(t_add, n, fold_iter(arr, n, 0, add));
+  BENCH_NS(t_max, n, fold_iter(arr, n, INT_MIN, max_val));
+  printf("%-20s %8.3f %8.3f\n", "fold_iter (fun_ptr)", t_add, t_max);
+
+  BENCH_NS(t_add, n, fold_i32_add(arr, n));
+  BENCH_NS(t_max, n, fold_i32_max(arr, n));
+  printf("%-20s %8.3f %8.3f\n", "FOLD_DEFINE int32", t_add, t_max);
+
+  BENCH_NS(t_add, n, fold_i64_add(arr64, n));
+  BENCH_NS(t_max, n, fold_i64_max(arr64, n));
+  printf("%-20s %8.3f %8.3f\n", "FOLD_DEFINE int64", t_add, t_max);
+
+  BENCH_NS(t_add, n, fold_f32_add(arr_f, n));
+  BENCH_NS(t_max, n, fold_f32_max(arr_f, n));
+  printf("%-20s %8.3f %8.3f\n", "FOLD_DEFINE float", t_add, t_max);
+
+  BENCH_NS(t_add, n, fold_f64_add(arr_d, n));
+  BENCH_NS(t_max, n, fold_f64_max(arr_d, n));
+  printf("%-20s %8.3f %8.3f\n", "FOLD_DEFINE double", t_add, t_max);
+
+  free(arr64);
+  free(arr_f);
+  free(arr_d);
+
+  return 0;
+}
+/* END: Typed fold benchmark */
+
 int main(void)
 {
   // fun_ptr_arr is an array of function pointers
   int *arr;
   int SIZE = 5;
+  const size_t BIG_SIZE = ((size_t) 1) << 24;
+  const char *names[] = {"Addition", "Multiplication", "Min value", "Max value"};
 
   int (*fun_ptr_arr[])(int, int) = {add, multiply, min_val, max_val};
   int seeds[] = {0, 1, INT_MAX, INT_MIN};
+  fold_op_t ops[4];
+  int many_res[4];
+  int file_res[4];
+  int fd;
 
   if ((arr = gen_ran_arr(SIZE)) == NULL) return 1;
 
@@ -49,6 +597,53 @@ int main(void)
 
   free(arr);
 
+  // Too large for the recursive fold(), compare against fold_iter()
+  if ((arr = gen_ran_arr(BIG_SIZE)) == NULL) return 1;
+
+  for (int i = 0; i < 4; ++i) {
+    ops[i].seed = seeds[i];
+    ops[i].fun_ptr = fun_ptr_arr[i];
+  }
+  fold_many(arr, BIG_SIZE, ops, many_res, 4);
+
+  if ((fd = write_tmp_file(arr, BIG_SIZE)) < 0) {
+    free(arr);
+    return 1;
+  }
+  // No operators is not an error, whatever malloc(0) returns
+  if (fold_fd(fd, ops, file_res, 0) || fold_fd(fd, ops, file_res, 4)) {
+    printf("Error while folding a temporary file\n");
+    close(fd);
+    free(arr);
+    return 1;
+  }
+  close(fd);
+
+  for (int i = 0; i < 4; ++i) {
+    int expected = fold_iter(arr, BIG_SIZE, seeds[i], fun_ptr_arr[i]);
+    int got = fold_parallel(arr, BIG_SIZE, seeds[i], fun_ptr_arr[i]);
+
+    printf("%s on %zu numbers: %d (parallel %s, fused %s, file %s)\n", names[i], BIG_SIZE, got,
+      got == expected ? "pass" : "FAIL", many_res[i] == expected ? "pass" : "FAIL",
+      file_res[i] == expected ? "pass" : "FAIL");
+  }
+
+  // Prefix scans with the threads forced on, even on a single core
+  for (int i = 0; i < 4; ++i) {
+    if (fun_ptr_arr[i] == multiply) continue;
+    printf("%s scan on %zu numbers: inclusive %s, exclusive %s\n", names[i], BIG_SIZE,
+      check_scan(arr, BIG_SIZE, seeds[i], fun_ptr_arr[i], 0, 8) ? "pass" : "FAIL",
+      check_scan(arr, BIG_SIZE, seeds[i], fun_ptr_arr[i], 1, 8) ? "pass" : "FAIL");
+  }
+
+  free(arr);
+
+  if ((arr = gen_ran_arr(BENCH_SIZE)) == NULL) return 1;
+  if (bench_folds(arr, BENCH_SIZE)) {
+    free(arr);
+    return 1;
+  }
+  free(arr);
+
   return 0;
 }
-
@@ -1,49 +1,1114 @@
-#include <stdlib.h> // free()
+#include <limits.h> // INT_MAX
+#include <stdlib.h> // free(), qsort()
 #include <stdio.h>
+#include <string.h> // memcpy()
+#include "partition.h"
+#include "sort_typed.h"
 #include "util.h"
 
+#define SELECT_SMALL    ((size_t) 16)
+#define NINTHER_CUTOFF  ((size_t) 128)
+
 static void swap(int *a, int *b)
 {
-  if (*a == *b) return;
+  int t = *a;
 
-  *a ^= *b;
-  *b ^= *a;
-  *a ^= *b;
+  *a = *b;
+  *b = t;
 }
 
-static size_t partition(int *arr, size_t high)
+static void insertion_sort(int *arr, size_t n)
 {
-  int pivot = arr[high];
-  size_t i = 0;
+  for (size_t i = ((size_t) 1); i < n; ++i) {
+    int val = arr[i];
+    size_t j = i;
 
-  for (size_t j = ((size_t) 0); j < high; ++j)
-    if (arr[j] < pivot) swap(&arr[i++], &arr[j]);
+    for (; j > 0 && arr[j-1] > val; --j)
+      arr[j] = arr[j-1];
+    arr[j] = val;
+  }
+}
 
-  swap(&arr[i], &arr[high]);
+// Function to be use in qsort()
+int cmpfunc(const void *a, const void *b)
+{
+  int x = *((const int *) a);
+  int y = *((const int *) b);
 
-  return i;
+  return (x > y) - (x < y);
 }
 
-void k_minima(int *arr, ssize_t high, size_t k)
+static int cmp_size(const void *a, const void *b)
+{
+  size_t x = *((const size_t *) a);
+  size_t y = *((const size_t *) b);
+
+  return (x > y) - (x < y);
+}
+
+/* START: Pivot selection */
+static size_t median3(const int *arr, size_t a, size_t b, size_t c)
+{
+  if (arr[a] < arr[b]) {
+    if (arr[b] < arr[c]) return b;
+    return arr[a] < arr[c] ? c : a;
+  }
+  if (arr[a] < arr[c]) return a;
+  return arr[b] < arr[c] ? c : b;
+}
+
+/* Median of 3 for small arrays, Tukey's ninther (median of three
+   medians of 3) for large ones. Returns the index of the pivot.
+*/
+static size_t choose_pivot(const int *arr, size_t n)
+{
+  size_t mid = n/2;
+  size_t step;
+
+  if (n < NINTHER_CUTOFF) return median3(arr, 0, mid, n-1);
+
+  step = n/8;
+  return median3(arr,
+    median3(arr, 0, step, 2*step),
+    median3(arr, mid-step, mid, mid+step),
+    median3(arr, n-1-2*step, n-1-step, n-1));
+}
+
+static void select_rank(int *arr, size_t n, size_t k, size_t depth);
+
+/* Median of medians of groups of 5, the pivot that guarantees the
+   linear worst case. The group medians are gathered at the front
+   of the array and their median is selected recursively.
+*/
+static size_t median_of_medians(int *arr, size_t n)
+{
+  size_t m = 0;
+
+  if (n <= 5) {
+    insertion_sort(arr, n);
+    return n/2;
+  }
+
+  for (size_t i = ((size_t) 0); i + 5 <= n; i += 5) {
+    insertion_sort(&arr[i], 5);
+    swap(&arr[m++], &arr[i+2]);
+  }
+
+  select_rank(arr, m, m/2, 0);
+
+  return m/2;
+}
+/* END: Pivot selection */
+
+/* Introselect: quickselect with median-of-3/ninther pivots, falling
+   back to median of medians once depth partitions have been spent,
+   so the worst case stays O(n). Partitions with partition_int(),
+   the AVX2 kernel when available.
+
+   Rearranges arr so that arr[k] is the element of rank k (0-based),
+   arr[0..k) <= arr[k] <= arr(k..n).
+*/
+static void select_rank(int *arr, size_t n, size_t k, size_t depth)
+{
+  size_t p, e;
+  int pivot;
+
+  while (n > SELECT_SMALL) {
+    if (depth == 0) {
+      p = median_of_medians(arr, n);
+    } else {
+      p = choose_pivot(arr, n);
+      --depth;
+    }
+
+    // arr[0..p) < pivot <= arr[p..n)
+    pivot = arr[p];
+    p = partition_int(arr, n, pivot);
+
+    if (k < p) {
+      n = p;
+      continue;
+    }
+
+    // Few keys below the pivot: split off the keys equal to it so
+    // runs of duplicates cannot stall the selection
+    e = p;
+    if (p < n/4) e = (pivot == INT_MAX) ? n : p + partition_int(&arr[p], n-p, pivot+1);
+    if (k < e) return;
+
+    arr = &arr[e];
+    n -= e;
+    k -= e;
+  }
+
+  insertion_sort(arr, n);
+}
+
+static size_t depth_limit(size_t n)
+{
+  size_t depth = 0;
+
+  for (; n > 1; n >>= 1) depth += 2;
+
+  return depth;
+}
+
+/* START: Multi-rank selection */
+
+// Index of the first rank >= val in the m sorted ranks
+static size_t ranks_lower_bound(const size_t *ranks, size_t m, size_t val)
+{
+  size_t lo = 0, hi = m;
+
+  while (lo < hi) {
+    size_t mid = lo + (hi-lo)/2;
+
+    if (ranks[mid] < val) lo = mid + 1;
+    else hi = mid;
+  }
+
+  return lo;
+}
+
+/* ranks are positions in the whole array, arr starts at position
+   base of it and every rank lies in [base, base+n).
+*/
+static void multi_select_rec(int *arr, size_t base, size_t n, const size_t *ranks, size_t m, size_t depth)
 {
-  if (high <= 0) return;
+  size_t p, e, m_left, m_mid;
+  int pivot;
 
-  size_t pi = partition(arr, (size_t) high);
+  while (m > 0) {
+    if (m == 1 || n <= SELECT_SMALL) {
+      // A single rank, or small enough that one pass orders them all
+      if (m == 1) select_rank(arr, n, ranks[0] - base, depth);
+      else insertion_sort(arr, n);
+      return;
+    }
 
-  if (pi == k-1) return;
+    if (depth == 0) {
+      p = median_of_medians(arr, n);
+    } else {
+      p = choose_pivot(arr, n);
+      --depth;
+    }
 
-  // Only sort sub array above pivot if k > pivot
-  if (pi < k)
-    k_minima(&arr[pi+1], high-(pi+1), k-(pi+1));
+    pivot = arr[p];
+    p = partition_int(arr, n, pivot);
+    e = p;
+    if (p < n/4) e = (pivot == INT_MAX) ? n : p + partition_int(&arr[p], n-p, pivot+1);
+
+    // Ranks below p are on the left, ranks in [p, e) hold the
+    // pivot and are done, ranks from e on are on the right
+    m_left = ranks_lower_bound(ranks, m, base + p);
+    m_mid = ranks_lower_bound(ranks, m, base + e);
+
+    multi_select_rec(arr, base, p, ranks, m_left, depth);
+
+    arr = &arr[e];
+    base += e;
+    n -= e;
+    ranks = &ranks[m_mid];
+    m -= m_mid;
+  }
+}
+
+/* Finds the elements of several ranks in one recursive pass:
+   afterwards arr[ranks[i]] is the element of rank ranks[i]
+   (0-based) and arr is partitioned around each of them, as if
+   k_minima() had been called for every rank.
+
+   Each partition only recurses into the sides that still contain
+   requested ranks, so the cost is O(n log m) instead of O(n m).
+
+   ranks must be sorted in increasing order and below n.
+*/
+void multi_select(int *arr, size_t n, const size_t *ranks, size_t m)
+{
+  if (n == 0) return;
+  multi_select_rec(arr, 0, n, ranks, m, depth_limit(n));
+}
+/* END: Multi-rank selection */
+
+/* START: Floyd-Rivest sampling selection */
+#define SAMPLE_SELECT_MIN    (((size_t) 1) << 16)
+#define SAMPLE_SELECT_RATIO  ((size_t) 16)
+
+static size_t isqrt(size_t x)
+{
+  size_t r = 0;
+
+  for (size_t bit = ((size_t) 1) << 31; bit > 0; bit >>= 1)
+    if ((r + bit)*(r + bit) <= x) r += bit;
+
+  return r;
+}
+
+static size_t icbrt(size_t x)
+{
+  size_t r = 0;
+
+  for (size_t bit = ((size_t) 1) << 21; bit > 0; bit >>= 1)
+    if ((r + bit)*(r + bit)*(r + bit) <= x) r += bit;
+
+  return r;
+}
+
+static inline uint64_t xorshift64(uint64_t *state)
+{
+  *state ^= *state << 13;
+  *state ^= *state >> 7;
+  *state ^= *state << 17;
+
+  return *state;
+}
+
+/* Floyd-Rivest selection, same result as select_rank().
+
+   A random sample of about n^(2/3)/2 elements is moved to the front
+   and two pivots are selected from it, sqrt(s log n) sample ranks
+   below and above where rank k should fall. One partition pass over
+   the whole array keeps only the keys between them (for k below
+   n/2 the upper filter runs first, so only the survivors are split
+   on the lower pivot), and selection finishes on that small set.
+   If the sample was unlucky and rank k is not among the survivors,
+   select_rank() runs on the side that holds it, the result is the
+   same.
+*/
+static void sample_select(int *arr, size_t n, size_t k)
+{
+  size_t c = icbrt(n);
+  size_t s = c*c/2;
+  size_t gap = isqrt(s*depth_limit(n)/2);
+  size_t r = k*s/n;
+  size_t ranks[2], m = 0;
+  size_t p1, p2;
+  uint64_t seed = 0x9e3779b97f4a7c15ULL ^ (uint64_t) n;
+  int has_lo, has_hi, lo = 0, hi = 0;
+
+  // Partial Fisher-Yates shuffle, the sample ends up in arr[0..s)
+  for (size_t i = ((size_t) 0); i < s; ++i)
+    swap(&arr[i], &arr[i + xorshift64(&seed)%(n-i)]);
+
+  has_lo = (r >= gap);
+  has_hi = (r + gap < s);
+  if (has_lo) ranks[m++] = r - gap;
+  if (has_hi) ranks[m++] = r + gap;
+  multi_select(arr, s, ranks, m);
+  if (has_lo) lo = arr[r - gap];
+  if (has_hi) hi = arr[r + gap];
+  if (hi == INT_MAX) has_hi = 0;
+
+  // arr[0..p1) < lo <= arr[p1..p2) <= hi < arr[p2..n)
+  if (k < n/2) {
+    p2 = has_hi ? partition_int(arr, n, hi+1) : n;
+    p1 = has_lo ? partition_int(arr, p2, lo) : 0;
+  } else {
+    p1 = has_lo ? partition_int(arr, n, lo) : 0;
+    p2 = has_hi ? p1 + partition_int(&arr[p1], n-p1, hi+1) : n;
+  }
+
+  if (k < p1) select_rank(arr, p1, k, depth_limit(p1));
+  else if (k < p2) select_rank(&arr[p1], p2-p1, k-p1, depth_limit(p2-p1));
+  else select_rank(&arr[p2], n-p2, k-p2, depth_limit(n-p2));
+}
+/* END: Floyd-Rivest sampling selection */
+
+/* Leaves the k smallest values of arr[0..high] in arr[0..k-1].
+
+   Large arrays where k is within n/SAMPLE_SELECT_RATIO of either end
+   use the Floyd-Rivest sampling mode, which touches the whole array
+   in a single pass, anything else uses introselect.
+*/
+void k_minima(int *arr, ssize_t high, size_t k)
+{
+  size_t n = (size_t) (high+1);
+
+  if (high <= 0 || k == 0) return;
+  if (k > n) k = n;
+
+  if (n >= SAMPLE_SELECT_MIN && (k < n/SAMPLE_SELECT_RATIO || n-k < n/SAMPLE_SELECT_RATIO))
+    sample_select(arr, n, k-1);
   else
-    k_minima(arr, pi-1, k);
+    select_rank(arr, n, k-1, depth_limit(n));
+}
+
+/* START: Parallel selection */
+#define PAR_SELECT_MIN  (((size_t) 1) << 18)
+#define PAR_BUCKETS     64
+#define PAR_OVERSAMPLE  32
+#define PAR_MAX_THREADS_PER_CPU  4
+
+enum par_phase { PAR_SAMPLE, PAR_COUNT, PAR_SCATTER, PAR_COPY };
+
+typedef struct {
+  enum par_phase phase;
+  int *arr;
+  int *tmp;
+  size_t lo, hi;              // chunk of this thread
+  const int *splitters;       // PAR_BUCKETS-1 sorted splitters
+  int *sample;                // where this thread writes its samples
+  size_t n_sample;
+  size_t count[PAR_BUCKETS];  // bucket sizes in the chunk
+  size_t offset[PAR_BUCKETS]; // where the chunk's buckets go in tmp
+} par_select_job_t;
+
+/* Number of splitters <= val, the bucket val belongs to. The loop
+   has a fixed trip count and no data dependent branch.
+*/
+static inline size_t bucket_of(const int *splitters, int val)
+{
+  size_t b = 0;
+
+  for (size_t step = PAR_BUCKETS/2; step > 0; step /= 2)
+    b += (val >= splitters[b+step-1]) ? step : 0;
+
+  return b;
 }
 
+static void *par_select_job(void *arg)
+{
+  par_select_job_t *job = (par_select_job_t *) arg;
+  size_t i, stride;
+
+  switch (job->phase) {
+  case PAR_SAMPLE:
+    stride = (job->hi - job->lo)/job->n_sample;
+    for (i = ((size_t) 0); i < job->n_sample; ++i)
+      job->sample[i] = job->arr[job->lo + i*stride];
+    break;
+  case PAR_COUNT:
+    memset(job->count, 0, sizeof(job->count));
+    for (i = job->lo; i < job->hi; ++i)
+      ++job->count[bucket_of(job->splitters, job->arr[i])];
+    break;
+  case PAR_SCATTER:
+    for (i = job->lo; i < job->hi; ++i)
+      job->tmp[job->offset[bucket_of(job->splitters, job->arr[i])]++] = job->arr[i];
+    break;
+  case PAR_COPY:
+    memcpy(&job->arr[job->lo], &job->tmp[job->lo], (job->hi - job->lo)*sizeof(int));
+    break;
+  }
+
+  return NULL;
+}
+
+static void par_select_run(par_select_job_t *jobs, size_t n_threads, enum par_phase phase)
+{
+  for (size_t t = ((size_t) 0); t < n_threads; ++t)
+    jobs[t].phase = phase;
+  parallel_run(par_select_job, jobs, sizeof(par_select_job_t), n_threads);
+}
+
+/* Parallel k_minima for very large arrays, same contract: the k
+   smallest values end up in arr[0..k-1].
+
+   Each round, every thread samples its chunk, PAR_BUCKETS-1
+   splitters are taken from the sorted sample, the threads count
+   then scatter their chunk into per thread slices of each bucket
+   of a scratch array, and the buckets are copied back in order.
+   Only the bucket holding rank k-1 is selected further. Ranges
+   below PAR_SELECT_MIN, or a round that makes no progress (all
+   keys equal), finish with the sequential introselect.
+
+   n_threads is capped at PAR_MAX_THREADS_PER_CPU per processor and
+   at one sample per thread (PAR_BUCKETS*PAR_OVERSAMPLE threads).
+   Needs a scratch array of n ints, falls back to k_minima() if it
+   cannot be allocated.
+*/
+void k_minima_parallel(int *arr, ssize_t high, size_t k, size_t n_threads)
+{
+  par_select_job_t *jobs;
+  int splitters[PAR_BUCKETS-1];
+  int *tmp, *sample;
+  size_t n = (size_t) (high+1);
+  size_t n_sample, start, size;
+
+  if (high <= 0 || k == 0) return;
+  if (k > n) k = n;
+  if (n_threads == 0) n_threads = 1;
+  if (n_threads > PAR_MAX_THREADS_PER_CPU*n_cpus()) n_threads = PAR_MAX_THREADS_PER_CPU*n_cpus();
+  if (n_threads > PAR_BUCKETS*PAR_OVERSAMPLE) n_threads = PAR_BUCKETS*PAR_OVERSAMPLE;
+
+  tmp = (int *) malloc(n*sizeof(int));
+  sample = (int *) malloc(PAR_BUCKETS*PAR_OVERSAMPLE*sizeof(int));
+  jobs = (par_select_job_t *) malloc(n_threads*sizeof(par_select_job_t));
+  if (n_threads == 1 || tmp == NULL || sample == NULL || jobs == NULL) {
+    free(tmp);
+    free(sample);
+    free(jobs);
+    k_minima(arr, high, k);
+    return;
+  }
+
+  --k; // rank of the k-th smallest, 0-based
+
+  while (n >= PAR_SELECT_MIN) {
+    n_sample = ((size_t) (PAR_BUCKETS*PAR_OVERSAMPLE))/n_threads;
+    for (size_t t = ((size_t) 0); t < n_threads; ++t) {
+      jobs[t].arr = arr;
+      jobs[t].tmp = tmp;
+      jobs[t].lo = n*t/n_threads;
+      jobs[t].hi = n*(t+1)/n_threads;
+      jobs[t].splitters = splitters;
+      jobs[t].sample = &sample[t*n_sample];
+      jobs[t].n_sample = n_sample;
+    }
+
+    par_select_run(jobs, n_threads, PAR_SAMPLE);
+    qsort(sample, n_sample*n_threads, sizeof(int), cmpfunc);
+    for (size_t b = ((size_t) 0); b < PAR_BUCKETS-1; ++b)
+      splitters[b] = sample[(b+1)*n_sample*n_threads/PAR_BUCKETS];
+
+    par_select_run(jobs, n_threads, PAR_COUNT);
+
+    // Bucket b of thread t goes after all smaller buckets and after
+    // bucket b of the threads before t
+    start = 0;
+    for (size_t b = ((size_t) 0); b < PAR_BUCKETS; ++b) {
+      for (size_t t = ((size_t) 0); t < n_threads; ++t) {
+        jobs[t].offset[b] = start;
+        start += jobs[t].count[b];
+      }
+    }
+
+    par_select_run(jobs, n_threads, PAR_SCATTER);
+    par_select_run(jobs, n_threads, PAR_COPY);
+
+    // After the scatter, offset[b] of the last thread is the end of bucket b
+    size = n;
+    for (size_t b = ((size_t) 0); b < PAR_BUCKETS; ++b) {
+      size_t end = jobs[n_threads-1].offset[b];
+
+      if (k < end) {
+        start = jobs[0].offset[b] - jobs[0].count[b];
+        size = end - start;
+        break;
+      }
+    }
+
+    if (size == n) break;
+    arr = &arr[start];
+    n = size;
+    k -= start;
+  }
+
+  select_rank(arr, n, k, depth_limit(n));
+
+  free(tmp);
+  free(sample);
+  free(jobs);
+}
+/* END: Parallel selection */
+
+/* START: Streaming top-k */
+typedef struct {
+  size_t k;
+  size_t size;
+  int *heap;  // max-heap of the size <= k smallest values seen
+} topk_t;
+
+static void heap_sift_down(int *heap, size_t size, size_t i)
+{
+  int val = heap[i];
+  size_t child;
+
+  while ((child = 2*i + 1) < size) {
+    if (child + 1 < size && heap[child+1] > heap[child]) ++child;
+    if (heap[child] <= val) break;
+    heap[i] = heap[child];
+    i = child;
+  }
+  heap[i] = val;
+}
+
+static void heap_sift_up(int *heap, size_t i)
+{
+  int val = heap[i];
+
+  for (; i > 0 && heap[(i-1)/2] < val; i = (i-1)/2)
+    heap[i] = heap[(i-1)/2];
+  heap[i] = val;
+}
+
+/* Creates an accumulator for the k smallest values of a stream.
+   Uses O(k) memory whatever the length of the stream.
+
+   Returns NULL if out of memory.
+*/
+topk_t *topk_create(size_t k)
+{
+  topk_t *acc;
+
+  if ((acc = (topk_t *) malloc(sizeof(topk_t))) == NULL) return NULL;
+
+  acc->k = k;
+  acc->size = 0;
+  if ((acc->heap = (int *) malloc((k > 0 ? k : 1)*sizeof(int))) == NULL) {
+    free(acc);
+    return NULL;
+  }
+
+  return acc;
+}
+
+void topk_delete(topk_t *acc)
+{
+  if (acc == NULL) return;
+  free(acc->heap);
+  free(acc);
+}
+
+/* Adds a batch of n values to the accumulator.
+
+   O(n) while the values are larger than the k smallest so far,
+   O(n log k) in the worst case.
+*/
+void topk_push(topk_t *acc, const int *vals, size_t n)
+{
+  size_t i = 0;
+
+  // Nothing to keep, heap[0] does not exist
+  if (acc->k == 0) return;
+
+  // Fill the heap up to k values
+  for (; i < n && acc->size < acc->k; ++i) {
+    acc->heap[acc->size] = vals[i];
+    heap_sift_up(acc->heap, acc->size++);
+  }
+
+  // Then only values below the current k-th smallest get in
+  for (; i < n; ++i) {
+    if (vals[i] >= acc->heap[0]) continue;
+    acc->heap[0] = vals[i];
+    heap_sift_down(acc->heap, acc->size, 0);
+  }
+}
+
+/* Merges the values held by src into dst, so partial accumulators
+   from several producers can be combined. src is left unchanged.
+*/
+void topk_merge(topk_t *dst, const topk_t *src)
+{
+  topk_push(dst, src->heap, src->size);
+}
+
+/* Writes the k smallest values seen so far to out in increasing
+   order (fewer if less than k values were pushed).
+
+   Returns the number of values written.
+*/
+size_t topk_result(const topk_t *acc, int *out)
+{
+  memcpy(out, acc->heap, acc->size*sizeof(int));
+
+  // out is a max-heap, heap sort it in place
+  for (size_t end = acc->size; end > 1; --end) {
+    swap(&out[0], &out[end-1]);
+    heap_sift_down(out, end-1, 0);
+  }
+
+  return acc->size;
+}
+/* END: Streaming top-k */
+
+/* START: Tests and benchmark */
+#define BENCH_SIZE  ((size_t) 1000000)
+#define BENCH_REPS  5
+
+enum input_kind { RANDOM, SORTED, REVERSED, FEW_UNIQUE, ORGAN_PIPE, N_KINDS };
+
+static const char *kind_names[] = {"random", "sorted", "reversed", "few unique", "organ pipe"};
+
+static void fill_input(int *arr, size_t n, enum input_kind kind)
+{
+  for (size_t i = ((size_t) 0); i < n; ++i) {
+    switch (kind) {
+    case RANDOM:     arr[i] = rand(); break;
+    case SORTED:     arr[i] = (int) i; break;
+    case REVERSED:   arr[i] = (int) (n-i); break;
+    case FEW_UNIQUE: arr[i] = rand()%8; break;
+    default:         arr[i] = (int) (i < n/2 ? i : n-i); break;
+    }
+  }
+}
+
+/* Checks that k_minima() leaves the k smallest values of arr in
+   arr[0..k-1], comparing with a sorted copy. n_threads > 0 checks
+   k_minima_parallel() on that many threads instead.
+
+   Returns 1 on success, 0 otherwise.
+*/
+static int check_k_minima(const int *arr, size_t n, size_t k, size_t n_threads)
+{
+  int *sorted, *got;
+  int same_ans = 1;
+
+  sorted = (int *) malloc(n*sizeof(int));
+  got = (int *) malloc(n*sizeof(int));
+  if (sorted == NULL || got == NULL) {
+    free(sorted);
+    free(got);
+    return 0;
+  }
+
+  memcpy(sorted, arr, n*sizeof(int));
+  memcpy(got, arr, n*sizeof(int));
+
+  qsort(sorted, n, sizeof(int), cmpfunc);
+  if (n_threads == 0) k_minima(got, ((ssize_t) n)-1, k);
+  else k_minima_parallel(got, ((ssize_t) n)-1, k, n_threads);
+  qsort(got, k, sizeof(int), cmpfunc);
+
+  for (size_t i = ((size_t) 0); i < k; ++i)
+    if (got[i] != sorted[i]) same_ans = 0;
+
+  free(sorted);
+  free(got);
+
+  return same_ans;
+}
+
+/* Streams arr in batches into two accumulators, one per half as if
+   there were two producers, merges them and compares the result
+   with a sorted copy.
+
+   Returns 1 on success, 0 otherwise.
+*/
+static int check_topk(const int *arr, size_t n, size_t k, size_t batch)
+{
+  topk_t *acc1, *acc2;
+  int *sorted, *got;
+  size_t n_got, i;
+  int same_ans = 1;
+
+  acc1 = topk_create(k);
+  acc2 = topk_create(k);
+  sorted = (int *) malloc(n*sizeof(int));
+  got = (int *) malloc((k > 0 ? k : 1)*sizeof(int));
+  if (acc1 == NULL || acc2 == NULL || sorted == NULL || got == NULL) {
+    topk_delete(acc1);
+    topk_delete(acc2);
+    free(sorted);
+    free(got);
+    return 0;
+  }
+
+  for (i = ((size_t) 0); i < n/2; i += batch)
+    topk_push(acc1, &arr[i], (n/2 - i < batch ? n/2 - i : batch));
+  for (i = n/2; i < n; i += batch)
+    topk_push(acc2, &arr[i], (n - i < batch ? n - i : batch));
+  topk_merge(acc1, acc2);
+
+  memcpy(sorted, arr, n*sizeof(int));
+  qsort(sorted, n, sizeof(int), cmpfunc);
+
+  n_got = topk_result(acc1, got);
+  if (n_got != (k < n ? k : n)) same_ans = 0;
+  for (i = ((size_t) 0); i < n_got && same_ans; ++i)
+    if (got[i] != sorted[i]) same_ans = 0;
+
+  topk_delete(acc1);
+  topk_delete(acc2);
+  free(sorted);
+  free(got);
+
+  return same_ans;
+}
+
+/* Checks that partition_int() splits arr around pivot, keeps the
+   same multiset of values and agrees with partition_int_scalar(),
+   then that quick_sort() sorts it.
+
+   Returns 1 on success, 0 otherwise.
+*/
+static int check_partition(const int *arr, size_t n, int pivot)
+{
+  int *a, *b;
+  size_t m;
+  int same_ans = 1;
+
+  a = (int *) malloc((n > 0 ? n : 1)*sizeof(int));
+  b = (int *) malloc((n > 0 ? n : 1)*sizeof(int));
+  if (a == NULL || b == NULL) {
+    free(a);
+    free(b);
+    return 0;
+  }
+
+  memcpy(a, arr, n*sizeof(int));
+  memcpy(b, arr, n*sizeof(int));
+
+  m = partition_int(a, n, pivot);
+  if (m != partition_int_scalar(b, n, pivot)) same_ans = 0;
+  for (size_t i = ((size_t) 0); i < n; ++i)
+    if ((i < m) != (a[i] < pivot)) same_ans = 0;
+
+  qsort(a, n, sizeof(int), cmpfunc);
+  memcpy(b, arr, n*sizeof(int));
+  quick_sort(b, n);
+  if (n > 0 && memcmp(a, b, n*sizeof(int)) != 0) same_ans = 0;
+
+  free(a);
+  free(b);
+
+  return same_ans;
+}
+
+/* Times the partition kernels and quick_sort() against qsort() on
+   random input, best of BENCH_REPS, in ns per element.
+*/
+static int bench_partition(size_t n)
+{
+  int *input, *work;
+  double best[4], t;
+  int pivot;
+
+  input = (int *) malloc(n*sizeof(int));
+  work = (int *) malloc(n*sizeof(int));
+  if (input == NULL || work == NULL) {
+    free(input);
+    free(work);
+    return 1;
+  }
+
+  fill_input(input, n, RANDOM);
+  pivot = RAND_MAX/2;
+
+  for (int b = 0; b < 4; ++b) {
+    best[b] = 1e30;
+    for (int rep = 0; rep < BENCH_REPS; ++rep) {
+      memcpy(work, input, n*sizeof(int));
+      t = wall_time();
+      switch (b) {
+      case 0:  partition_int_scalar(work, n, pivot); break;
+      case 1:  partition_int(work, n, pivot); break;
+      case 2:  quick_sort(work, n); break;
+      default: qsort(work, n, sizeof(int), cmpfunc); break;
+      }
+      t = (wall_time() - t)*1e9/((double) n);
+      if (t < best[b]) best[b] = t;
+    }
+  }
+
+  printf("\nPartition benchmark on %zu random numbers, ns per element (best of %d)\n", n, BENCH_REPS);
+  printf("partition_int_scalar %8.3f\npartition_int        %8.3f\n", best[0], best[1]);
+  printf("quick_sort           %8.3f\nqsort                %8.3f\n", best[2], best[3]);
+
+  free(input);
+  free(work);
+
+  return 0;
+}
+
+/* Checks that multi_select() puts the element of every rank at its
+   position, comparing with a sorted copy.
+
+   Returns 1 on success, 0 otherwise.
+*/
+static int check_multi_select(const int *arr, size_t n, const size_t *ranks, size_t m)
+{
+  int *sorted, *got;
+  int same_ans = 1;
+
+  sorted = (int *) malloc(n*sizeof(int));
+  got = (int *) malloc(n*sizeof(int));
+  if (sorted == NULL || got == NULL) {
+    free(sorted);
+    free(got);
+    return 0;
+  }
+
+  memcpy(sorted, arr, n*sizeof(int));
+  memcpy(got, arr, n*sizeof(int));
+
+  qsort(sorted, n, sizeof(int), cmpfunc);
+  multi_select(got, n, ranks, m);
+
+  for (size_t i = ((size_t) 0); i < m; ++i)
+    if (got[ranks[i]] != sorted[ranks[i]]) same_ans = 0;
+
+  free(sorted);
+  free(got);
+
+  return same_ans;
+}
+
+// p50, p90, p99 and p99.9 of n elements
+static void percentile_ranks(size_t *ranks, size_t n)
+{
+  ranks[0] = n/2;
+  ranks[1] = n*9/10;
+  ranks[2] = n*99/100;
+  ranks[3] = n*999/1000;
+}
+
+/* Times multi_select() against one k_minima() call per rank on the
+   same array, for the 4 percentiles and for 100 evenly spaced ranks.
+*/
+static int bench_multi_select(size_t n)
+{
+  int *input, *work;
+  size_t ranks[100];
+  const size_t ms[] = {4, 100};
+  double best[2], t;
+
+  input = (int *) malloc(n*sizeof(int));
+  work = (int *) malloc(n*sizeof(int));
+  if (input == NULL || work == NULL) {
+    free(input);
+    free(work);
+    return 1;
+  }
+
+  fill_input(input, n, RANDOM);
+
+  printf("\nMulti-rank benchmark on %zu random numbers, ms (best of %d)\n", n, BENCH_REPS);
+  printf("%-8s %14s %14s\n", "ranks", "multi_select", "k_minima each");
+
+  for (int r = 0; r < 2; ++r) {
+    if (ms[r] == 4) percentile_ranks(ranks, n);
+    else for (size_t i = ((size_t) 0); i < ms[r]; ++i) ranks[i] = n*i/ms[r];
+
+    for (int b = 0; b < 2; ++b) {
+      best[b] = 1e30;
+      for (int rep = 0; rep < BENCH_REPS; ++rep) {
+        memcpy(work, input, n*sizeof(int));
+        t = wall_time();
+        if (b == 0) {
+          multi_select(work, n, ranks, ms[r]);
+        } else {
+          for (size_t i = ((size_t) 0); i < ms[r]; ++i)
+            k_minima(work, ((ssize_t) n)-1, ranks[i]+1);
+        }
+        t = wall_time() - t;
+        if (t < best[b]) best[b] = t;
+      }
+    }
+
+    printf("%-8zu %14.3f %14.3f\n", ms[r], best[0]*1e3, best[1]*1e3);
+  }
+
+  free(input);
+  free(work);
+
+  return 0;
+}
+
+/* Typed selections: ints on the partition_int() kernel, (key,
+   payload) records and (float, row) pairs */
+typedef struct {
+  float key;
+  uint32_t row;
+} rowf_t;
+
+SELECT_DEFINE_PARTITION(k_minima_int, int, SORT_LESS, partition_int)
+SELECT_DEFINE(k_minima_rec64, rec64_t, SORT_KEY_LESS)
+SELECT_DEFINE(k_minima_rowf, rowf_t, SORT_KEY_LESS)
+
+/* Checks the typed selections against a sorted copy of arr, and that
+   payloads and row indices still match their keys.
+
+   Returns 1 on success, 0 otherwise.
+*/
+static int check_typed_select(const int *arr, size_t n, size_t k)
+{
+  int *sorted, *ints;
+  rec64_t *recs;
+  rowf_t *rows;
+  int same_ans = 1;
+
+  sorted = (int *) malloc(n*sizeof(int));
+  ints = (int *) malloc(n*sizeof(int));
+  recs = (rec64_t *) malloc(n*sizeof(rec64_t));
+  rows = (rowf_t *) malloc(n*sizeof(rowf_t));
+  if (sorted == NULL || ints == NULL || recs == NULL || rows == NULL) {
+    free(sorted);
+    free(ints);
+    free(recs);
+    free(rows);
+    return 0;
+  }
+
+  for (size_t i = ((size_t) 0); i < n; ++i) {
+    sorted[i] = ints[i] = arr[i];
+    recs[i].key = ((int64_t) arr[i]) << 32;
+    recs[i].payload = ((uint64_t) arr[i])*3 + 1;
+    rows[i].key = (float) arr[i];
+    rows[i].row = (uint32_t) i;
+  }
+
+  qsort(sorted, n, sizeof(int), cmpfunc);
+  k_minima_int(ints, n, k);
+  k_minima_rec64(recs, n, k);
+  k_minima_rowf(rows, n, k);
+  qsort(ints, k, sizeof(int), cmpfunc);
+
+  for (size_t i = ((size_t) 0); i < n; ++i) {
+    if (recs[i].payload != ((uint64_t) (recs[i].key >> 32))*3 + 1) same_ans = 0;
+    if (rows[i].key != (float) arr[rows[i].row]) same_ans = 0;
+    if (i >= k) continue;
+    if (ints[i] != sorted[i]) same_ans = 0;
+    if (recs[i].key > (((int64_t) sorted[k-1]) << 32)) same_ans = 0;
+    if (rows[i].key > (float) sorted[k-1]) same_ans = 0;
+  }
+
+  free(sorted);
+  free(ints);
+  free(recs);
+  free(rows);
+
+  return same_ans;
+}
+
+/* Times the typed selections against k_minima() for k = n/2 on
+   random input, best of BENCH_REPS.
+*/
+static int bench_typed_select(size_t n)
+{
+  int *input, *work;
+  rec64_t *recs_in, *recs;
+  double best[3], t;
+
+  input = (int *) malloc(n*sizeof(int));
+  work = (int *) malloc(n*sizeof(int));
+  recs_in = (rec64_t *) malloc(n*sizeof(rec64_t));
+  recs = (rec64_t *) malloc(n*sizeof(rec64_t));
+  if (input == NULL || work == NULL || recs_in == NULL || recs == NULL) {
+    free(input);
+    free(work);
+    free(recs_in);
+    free(recs);
+    return 1;
+  }
+
+  fill_input(input, n, RANDOM);
+  for (size_t i = ((size_t) 0); i < n; ++i) {
+    recs_in[i].key = (int64_t) input[i];
+    recs_in[i].payload = (uint64_t) i;
+  }
+
+  for (int b = 0; b < 3; ++b) {
+    best[b] = 1e30;
+    for (int rep = 0; rep < BENCH_REPS; ++rep) {
+      memcpy(work, input, n*sizeof(int));
+      memcpy(recs, recs_in, n*sizeof(rec64_t));
+      t = wall_time();
+      if (b == 0) k_minima(work, ((ssize_t) n)-1, n/2);
+      else if (b == 1) k_minima_int(work, n, n/2);
+      else k_minima_rec64(recs, n, n/2);
+      t = wall_time() - t;
+      if (t < best[b]) best[b] = t;
+    }
+  }
+
+  printf("\nTyped selection benchmark on %zu random numbers, k = n/2, ms (best of %d)\n", n, BENCH_REPS);
+  printf("k_minima             %8.3f\nSELECT_DEFINE int    %8.3f\nSELECT_DEFINE rec64  %8.3f\n",
+    best[0]*1e3, best[1]*1e3, best[2]*1e3);
+
+  free(input);
+  free(work);
+  free(recs_in);
+  free(recs);
+
+  return 0;
+}
+
+/* Times introselect against the sampling mode on random input for
+   a few k, best of BENCH_REPS.
+*/
+static int bench_sample_select(size_t n)
+{
+  int *input, *work;
+  const size_t ks[] = {100, n/100, n/16, n/2};
+  double best[2], t;
+
+  input = (int *) malloc(n*sizeof(int));
+  work = (int *) malloc(n*sizeof(int));
+  if (input == NULL || work == NULL) {
+    free(input);
+    free(work);
+    return 1;
+  }
+
+  fill_input(input, n, RANDOM);
+
+  printf("\nSampling mode benchmark on %zu random numbers, ms (best of %d)\n", n, BENCH_REPS);
+  printf("%-10s %12s %12s\n", "k", "introselect", "floyd-rivest");
+
+  for (int i = 0; i < 4; ++i) {
+    for (int b = 0; b < 2; ++b) {
+      best[b] = 1e30;
+      for (int rep = 0; rep < BENCH_REPS; ++rep) {
+        memcpy(work, input, n*sizeof(int));
+        t = wall_time();
+        if (b == 0) select_rank(work, n, ks[i]-1, depth_limit(n));
+        else sample_select(work, n, ks[i]-1);
+        t = wall_time() - t;
+        if (t < best[b]) best[b] = t;
+      }
+    }
+    printf("%-10zu %12.3f %12.3f\n", ks[i], best[0]*1e3, best[1]*1e3);
+  }
+
+  free(input);
+  free(work);
+
+  return 0;
+}
+
+/* Times k_minima() for k = 100 and k = n/2 on each input kind,
+   best of BENCH_REPS, with qsort() of the whole array as reference.
+*/
+static int bench_k_minima(size_t n)
+{
+  int *input, *work;
+  const size_t ks[] = {100, n/2};
+  double best[3], t;
+
+  input = (int *) malloc(n*sizeof(int));
+  work = (int *) malloc(n*sizeof(int));
+  if (input == NULL || work == NULL) {
+    free(input);
+    free(work);
+    return 1;
+  }
+
+  printf("\nk_minima benchmark on %zu numbers, ms (best of %d)\n", n, BENCH_REPS);
+  printf("%-12s %10s %10s %10s\n", "input", "k=100", "k=n/2", "qsort");
+
+  for (int kind = 0; kind < N_KINDS; ++kind) {
+    fill_input(input, n, (enum input_kind) kind);
+
+    for (int b = 0; b < 3; ++b) {
+      best[b] = 1e30;
+      for (int rep = 0; rep < BENCH_REPS; ++rep) {
+        memcpy(work, input, n*sizeof(int));
+        t = wall_time();
+        if (b < 2) k_minima(work, ((ssize_t) n)-1, ks[b]);
+        else qsort(work, n, sizeof(int), cmpfunc);
+        t = wall_time() - t;
+        if (t < best[b]) best[b] = t;
+      }
+    }
+
+    printf("%-12s %10.3f %10.3f %10.3f\n", kind_names[kind], best[0]*1e3, best[1]*1e3, best[2]*1e3);
+  }
+
+  free(input);
+  free(work);
+
+  return 0;
+}
+/* END: Tests and benchmark */
+
 int main(void)
 {
   int *nums;
   int SIZE = 10;
   size_t k = 5;
+  size_t n_pass, n_tests;
 
   if ((nums = gen_ran_arr(SIZE)) == NULL) return 1;
 
@@ -59,6 +1124,125 @@ int main(void)
 
   free(nums);
 
-  return 0;
-}
+  // Every input kind, small and large sizes, several k
+  for (int kind = 0; kind < N_KINDS; ++kind) {
+    n_pass = n_tests = 0;
+    for (size_t size = ((size_t) 1); size < ((size_t) 100000); size = size*3 + 1) {
+      if ((nums = (int *) malloc(size*sizeof(int))) == NULL) return 1;
+      fill_input(nums, size, (enum input_kind) kind);
+
+      for (k = 1; k <= size; k = k*2 + 1) {
+        n_pass += (size_t) check_k_minima(nums, size, k, 0);
+        ++n_tests;
+      }
+      n_pass += (size_t) check_k_minima(nums, size, size, 0);
+      ++n_tests;
+
+      free(nums);
+    }
+    printf("%zu/%zu pass for %s input\n", n_pass, n_tests, kind_names[kind]);
+  }
+
+  // Partition kernels and quick_sort, pivots below, inside and above the values
+  for (int kind = 0; kind < N_KINDS; ++kind) {
+    n_pass = n_tests = 0;
+    for (size_t size = ((size_t) 0); size < ((size_t) 100000); size = size*3 + 1) {
+      if ((nums = (int *) malloc((size > 0 ? size : 1)*sizeof(int))) == NULL) return 1;
+      fill_input(nums, size, (enum input_kind) kind);
+
+      n_pass += (size_t) check_partition(nums, size, INT_MIN);
+      n_pass += (size_t) check_partition(nums, size, size > 0 ? nums[size/2] : 0);
+      n_pass += (size_t) check_partition(nums, size, INT_MAX);
+      n_tests += 3;
 
+      free(nums);
+    }
+    printf("%zu/%zu partition and quick_sort pass for %s input\n", n_pass, n_tests, kind_names[kind]);
+  }
+
+  // Typed selections on int, (int64 key, payload) and (float, row)
+  for (int kind = 0; kind < N_KINDS; ++kind) {
+    n_pass = n_tests = 0;
+    for (size_t size = ((size_t) 1); size < ((size_t) 100000); size = size*3 + 1) {
+      if ((nums = (int *) malloc(size*sizeof(int))) == NULL) return 1;
+      fill_input(nums, size, (enum input_kind) kind);
+
+      for (k = 1; k <= size; k = k*4 + 1) {
+        n_pass += (size_t) check_typed_select(nums, size, k);
+        ++n_tests;
+      }
+
+      free(nums);
+    }
+    printf("%zu/%zu typed selection pass for %s input\n", n_pass, n_tests, kind_names[kind]);
+  }
+
+  // Percentiles and random sets of ranks, duplicates included
+  for (int kind = 0; kind < N_KINDS; ++kind) {
+    size_t ranks[64];
+
+    n_pass = n_tests = 0;
+    for (size_t size = ((size_t) 1); size < ((size_t) 100000); size = size*3 + 1) {
+      if ((nums = (int *) malloc(size*sizeof(int))) == NULL) return 1;
+      fill_input(nums, size, (enum input_kind) kind);
+
+      percentile_ranks(ranks, size);
+      n_pass += (size_t) check_multi_select(nums, size, ranks, 4);
+
+      for (size_t i = ((size_t) 0); i < 64; ++i)
+        ranks[i] = ((size_t) rand())%size;
+      qsort(ranks, 64, sizeof(size_t), cmp_size);
+      n_pass += (size_t) check_multi_select(nums, size, ranks, 64);
+      n_tests += 2;
+
+      free(nums);
+    }
+    printf("%zu/%zu multi_select pass for %s input\n", n_pass, n_tests, kind_names[kind]);
+  }
+
+  // Parallel selection with 4 threads, forced even on a single core
+  for (int kind = 0; kind < N_KINDS; ++kind) {
+    const size_t size = BENCH_SIZE*3;
+
+    n_pass = n_tests = 0;
+    if ((nums = (int *) malloc(size*sizeof(int))) == NULL) return 1;
+    fill_input(nums, size, (enum input_kind) kind);
+
+    for (k = 1; k <= size; k = k*10) {
+      n_pass += (size_t) check_k_minima(nums, size, k, 4);
+      ++n_tests;
+    }
+    n_pass += (size_t) check_k_minima(nums, size, size/2, 4);
+    n_pass += (size_t) check_k_minima(nums, size, size, 4);
+    // More threads than samples, capped by k_minima_parallel()
+    n_pass += (size_t) check_k_minima(nums, size, size/3, 5000);
+    n_tests += 3;
+
+    free(nums);
+    printf("%zu/%zu parallel pass for %s input\n", n_pass, n_tests, kind_names[kind]);
+  }
+
+  // Streaming accumulators, batches of 1000 values
+  for (int kind = 0; kind < N_KINDS; ++kind) {
+    n_pass = n_tests = 0;
+    for (size_t size = ((size_t) 1); size < ((size_t) 100000); size = size*3 + 1) {
+      if ((nums = (int *) malloc(size*sizeof(int))) == NULL) return 1;
+      fill_input(nums, size, (enum input_kind) kind);
+
+      for (k = 0; k <= 2*size; k = k*2 + 1) {
+        n_pass += (size_t) check_topk(nums, size, k, 1000);
+        ++n_tests;
+      }
+
+      free(nums);
+    }
+    printf("%zu/%zu top-k stream pass for %s input\n", n_pass, n_tests, kind_names[kind]);
+  }
+
+  if (bench_k_minima(BENCH_SIZE)) return 1;
+  if (bench_multi_select(BENCH_SIZE)) return 1;
+  if (bench_sample_select(10*BENCH_SIZE)) return 1;
+  if (bench_typed_select(BENCH_SIZE)) return 1;
+
+  return bench_partition(BENCH_SIZE);
+}
@@ -1,6 +1,9 @@
 #include <stdio.h>  // printf()
 #include <stdlib.h> // qsort(), malloc(), free()
 #include <string.h> // memcpy()
+#include <stdint.h> // int64_t, uint64_t
+#include "sort.h"
+#include "sort_typed.h"
 #include "util.h"
 
 // Function to be use in qsort() to compare merge sort result
@@ -17,40 +20,195 @@ static int eq_arr(const int *a, const int *b, const size_t n)
   return 1;
 }
 
-static int merge(int *arr, size_t l_size, size_t r_size)
+/* START: Test inputs */
+enum input_kind { RANDOM, SORTED, REVERSED, NEARLY_SORTED, SEGMENTS, FEW_UNIQUE };
+static const char *input_name[] = {
+  "random", "sorted", "reversed", "nearly sorted", "sorted segments", "few unique"
+};
+#define N_INPUT_KINDS 6
+
+static void fill_input(int *arr, size_t n, enum input_kind kind)
+{
+  size_t seg = n/16 + 1;
+
+  for (size_t i = 0; i < n; ++i) {
+    switch (kind) {
+    case RANDOM:        arr[i] = rand(); break;
+    case SORTED:        arr[i] = (int) i; break;
+    case REVERSED:      arr[i] = (int) (n-i); break;
+    case NEARLY_SORTED: arr[i] = (int) i; break;
+    case SEGMENTS:      arr[i] = (int) ((i % seg)*7 + i/seg); break;
+    case FEW_UNIQUE:    arr[i] = rand() % 8; break;
+    }
+  }
+
+  // 1% random swaps
+  if (kind == NEARLY_SORTED && n > 1) {
+    for (size_t i = 0; i < n/100; ++i) {
+      size_t a = (size_t) rand() % n, b = (size_t) rand() % n;
+      int t = arr[a];
+      arr[a] = arr[b];
+      arr[b] = t;
+    }
+  }
+}
+
+/* END: Test inputs */
+
+/* START: Parallel merge sort tests */
+// Parallel sort against merge_sort() for several thread counts,
+// including ones that are not powers of two
+static int check_merge_sort_parallel(size_t size, size_t n_threads)
 {
-  int *l_arr = arr;
-  int *r_arr = &arr[l_size];
-  int *temp;
+  int *arr, *copy_arr;
+  int pass;
+
+  if ((arr = gen_ran_arr(size)) == NULL) return -1;
+  if ((copy_arr = (int *) malloc(size*sizeof(int))) == NULL) {
+    free(arr);
+    return -1;
+  }
+  memcpy(copy_arr, arr, size*sizeof(int));
+
+  if (merge_sort_parallel(arr, size, n_threads) || merge_sort(copy_arr, size)) {
+    free(arr);
+    free(copy_arr);
+    return -1;
+  }
+  pass = eq_arr(arr, copy_arr, size);
 
-  size_t l_i = 0;
-  size_t r_i = 0;
-  size_t t_i = 0;
+  free(arr);
+  free(copy_arr);
 
-  if ((temp = (int *) malloc(l_size+r_size+1)) == NULL) return 1;
+  return pass;
+}
 
-  while (l_i < l_size && r_i < r_size)
-    temp[t_i++] = (l_arr[l_i] < r_arr[r_i] ? l_arr[l_i++] : r_arr[r_i++]);
+/* END: Parallel merge sort tests */
 
-  while (l_i < l_size) temp[t_i++] = l_arr[l_i++];
+/* START: Typed sorting tests */
 
-  while (r_i < r_size) temp[t_i++] = r_arr[r_i++];
+MERGE_SORT_DEFINE(merge_sort_int, int, SORT_LESS)
+MERGE_SORT_DEFINE(merge_sort_rec64, rec64_t, SORT_KEY_LESS)
+MERGE_SORT_DEFINE(merge_sort_i64, int64_t, SORT_LESS)
+ARGSORT_DEFINE(argsort_float, float, SORT_LESS)
 
-  memcpy(arr, temp, (l_size+r_size)*sizeof(int));
-  free(temp);
+// Typed int sort against merge_sort(), rec64 sort for stability
+// (payload is the original position) and argsort on floats
+static int check_typed_sort(size_t size)
+{
+  int *arr, *copy_arr;
+  rec64_t *recs;
+  float *keys;
+  size_t *perm;
+  int pass = 1;
 
-  return 0;
+  if ((arr = gen_ran_arr(size)) == NULL) return -1;
+  copy_arr = (int *) malloc((size+1)*sizeof(int));
+  recs = (rec64_t *) malloc((size+1)*sizeof(rec64_t));
+  keys = (float *) malloc((size+1)*sizeof(float));
+  perm = (size_t *) malloc((size+1)*sizeof(size_t));
+  if (copy_arr == NULL || recs == NULL || keys == NULL || perm == NULL) {
+    free(arr); free(copy_arr); free(recs); free(keys); free(perm);
+    return -1;
+  }
+
+  for (size_t i = 0; i < size; ++i) {
+    copy_arr[i] = arr[i];
+    recs[i].key = (int64_t) arr[i] - 50;
+    recs[i].payload = (uint64_t) i;
+    keys[i] = (float) arr[i] / 7.0f;
+  }
+
+  if (merge_sort_int(arr, size) || merge_sort_rec64(recs, size)
+      || argsort_float(keys, perm, size)) {
+    free(arr); free(copy_arr); free(recs); free(keys); free(perm);
+    return -1;
+  }
+  qsort(copy_arr, size, sizeof(int), cmpfunc);
+
+  pass &= eq_arr(arr, copy_arr, size);
+  for (size_t i = 0; i < size; ++i)
+    pass &= recs[i].key == (int64_t) copy_arr[i] - 50;
+  for (size_t i = 1; i < size; ++i) {
+    pass &= recs[i].key > recs[i-1].key
+            || (recs[i].key == recs[i-1].key && recs[i].payload > recs[i-1].payload);
+    pass &= keys[perm[i]] > keys[perm[i-1]]
+            || (keys[perm[i]] == keys[perm[i-1]] && perm[i] > perm[i-1]);
+  }
+  if (size > 0) pass &= keys[perm[0]] == (float) copy_arr[0] / 7.0f;
+
+  free(arr);
+  free(copy_arr);
+  free(recs);
+  free(keys);
+  free(perm);
+
+  return pass;
+}
+
+// int64 radix sort against the typed merge sort, on full range
+// keys and on keys with only the low bits set (skipped passes)
+static int check_radix_i64(size_t size)
+{
+  int64_t *arr = (int64_t *) malloc((size+1)*sizeof(int64_t));
+  int64_t *copy_arr = (int64_t *) malloc((size+1)*sizeof(int64_t));
+  int pass = 1;
+
+  if (arr == NULL || copy_arr == NULL) {
+    free(arr);
+    free(copy_arr);
+    return -1;
+  }
+
+  for (int narrow = 0; narrow < 2; ++narrow) {
+    for (size_t i = 0; i < size; ++i) {
+      uint64_t v = ((uint64_t) rand() << 42) ^ ((uint64_t) rand() << 21) ^ (uint64_t) rand();
+
+      arr[i] = narrow ? (int64_t) (v % 1000) - 500 : (int64_t) v;
+      copy_arr[i] = arr[i];
+    }
+
+    if (radix_sort_i64(arr, size) || merge_sort_i64(copy_arr, size)) pass = -1;
+    for (size_t i = 0; pass == 1 && i < size; ++i)
+      pass = arr[i] == copy_arr[i];
+  }
+
+  free(arr);
+  free(copy_arr);
+
+  return pass;
 }
 
-int merge_sort(int *arr, size_t n)
+/* END: Typed sorting tests */
+
+/* START: Bitonic merge tests */
+// Sorted runs of large then small values, so the last merge of
+// merge_sort_bitonic() takes every element of the short run before
+// the 8 held in the register (and the reverse when swapped)
+static int check_bitonic_tail(size_t size, int swapped)
 {
-  if (n <= 1) return 0;
-  size_t mid = n/2;
+  int *arr = (int *) malloc((size+1)*sizeof(int));
+  size_t width = 8;
+  int pass = 1;
+
+  if (arr == NULL) return -1;
+
+  while (2*width < size) width *= 2;
+  for (size_t i = 0; i < size; ++i) {
+    int big = (i < width) != swapped;
+
+    arr[i] = big ? (int) (1000 + i) : (int) (i % width);
+  }
+
+  if (merge_sort_bitonic(arr, size)) pass = -1;
+  for (size_t i = 1; pass == 1 && i < size; ++i)
+    pass = arr[i-1] <= arr[i];
+
+  free(arr);
 
-  if (merge_sort(arr, mid)) return 1;
-  if (merge_sort(&arr[mid], n-mid)) return 1;
-  return merge(arr, mid, n-mid);
+  return pass;
 }
+/* END: Bitonic merge tests */
 
 int main(void)
 {
@@ -87,6 +245,189 @@ int main(void)
     printf("%d/%d pass for array of size %zu\n", n_pass, N_TESTS, size);
   }
 
+  for (size = ((size_t) 0); size < ((size_t) 2000); size = size*3 + 1) {
+    n_pass = 0;
+    for (int i = 0; i < N_TESTS; ++i) {
+      int res = check_typed_sort(size);
+
+      if (res < 0) return 1;
+      n_pass += res;
+    }
+
+    printf("%d/%d typed sort pass for array of size %zu\n", n_pass, N_TESTS, size);
+  }
+
+  for (size = ((size_t) 0); size < ((size_t) 3000000); size = size*3 + 5) {
+    n_pass = 0;
+    for (int i = 0; i < N_TESTS; ++i) {
+      if ((arr = gen_ran_arr(size)) == NULL) return 1;
+      if ((copy_arr = (int *) malloc((size+1)*sizeof(int))) == NULL) {
+        free(arr);
+        return 1;
+      }
+      for (size_t j = 0; j < size; ++j) arr[j] = (int) ((unsigned) rand() - RAND_MAX/2);
+      memcpy(copy_arr, arr, size*sizeof(int));
+
+      if (merge_sort_bottom_up(arr, size) || merge_sort(copy_arr, size)) {
+        printf("Error while executing merge sort:(\n");
+        return 1;
+      }
+      n_pass += eq_arr(arr, copy_arr, size);
+
+      free(arr);
+      free(copy_arr);
+    }
+
+    printf("%d/%d bottom-up sort pass for array of size %zu\n", n_pass, N_TESTS, size);
+  }
+
+  // Odd tests keep the values 0..99 of gen_ran_arr(), with many ties
+  for (size = ((size_t) 0); size < ((size_t) 3000000); size = size*3 + 5) {
+    n_pass = 0;
+    for (int i = 0; i < N_TESTS; ++i) {
+      if ((arr = gen_ran_arr(size)) == NULL) return 1;
+      if ((copy_arr = (int *) malloc((size+1)*sizeof(int))) == NULL) {
+        free(arr);
+        return 1;
+      }
+      for (size_t j = 0; i % 2 == 0 && j < size; ++j) arr[j] = (int) ((unsigned) rand() - RAND_MAX/2);
+      memcpy(copy_arr, arr, size*sizeof(int));
+
+      if (merge_sort_bitonic(arr, size) || merge_sort(copy_arr, size)) {
+        printf("Error while executing merge sort:(\n");
+        return 1;
+      }
+      n_pass += eq_arr(arr, copy_arr, size);
+
+      free(arr);
+      free(copy_arr);
+    }
+
+    printf("%d/%d bitonic sort pass for array of size %zu\n", n_pass, N_TESTS, size);
+  }
+
+  n_pass = 0;
+  for (size = ((size_t) 9); size < ((size_t) 200); ++size) {
+    for (int swapped = 0; swapped < 2; ++swapped) {
+      int res = check_bitonic_tail(size, swapped);
+
+      if (res < 0) return 1;
+      n_pass += res;
+    }
+  }
+  printf("%d/%d bitonic sort pass for short final runs\n", n_pass, 2*(200-9));
+
+  for (int kind = 0; kind < N_INPUT_KINDS; ++kind) {
+    int n_tests = 0;
+
+    n_pass = 0;
+    for (size = ((size_t) 0); size < ((size_t) 300000); size = size*3 + 7, ++n_tests) {
+      if ((arr = (int *) malloc((size+1)*sizeof(int))) == NULL) return 1;
+      if ((copy_arr = (int *) malloc((size+1)*sizeof(int))) == NULL) {
+        free(arr);
+        return 1;
+      }
+      fill_input(arr, size, (enum input_kind) kind);
+      memcpy(copy_arr, arr, size*sizeof(int));
+
+      if (merge_sort_adaptive(arr, size) || merge_sort(copy_arr, size)) {
+        printf("Error while executing merge sort:(\n");
+        return 1;
+      }
+      n_pass += eq_arr(arr, copy_arr, size);
+
+      free(arr);
+      free(copy_arr);
+    }
+
+    printf("%d/%d adaptive sort pass for %s input\n", n_pass, n_tests, input_name[kind]);
+  }
+
+  for (int kind = 0; kind < N_INPUT_KINDS; ++kind) {
+    int n_tests = 0;
+
+    n_pass = 0;
+    for (size = ((size_t) 0); size < ((size_t) 300000); size = size*3 + 7, ++n_tests) {
+      if ((arr = (int *) malloc((size+1)*sizeof(int))) == NULL) return 1;
+      if ((copy_arr = (int *) malloc((size+1)*sizeof(int))) == NULL) {
+        free(arr);
+        return 1;
+      }
+      fill_input(arr, size, (enum input_kind) kind);
+      memcpy(copy_arr, arr, size*sizeof(int));
+
+      if (merge_sort_inplace(arr, size) || merge_sort(copy_arr, size)) {
+        printf("Error while executing merge sort:(\n");
+        return 1;
+      }
+      n_pass += eq_arr(arr, copy_arr, size);
+
+      free(arr);
+      free(copy_arr);
+    }
+
+    printf("%d/%d in-place sort pass for %s input\n", n_pass, n_tests, input_name[kind]);
+  }
+
+  for (int kind = 0; kind < N_INPUT_KINDS; ++kind) {
+    int n_tests = 0;
+
+    n_pass = 0;
+    for (size = ((size_t) 0); size < ((size_t) 300000); size = size*3 + 7, n_tests += 2) {
+      int *msd_arr;
+
+      if ((arr = (int *) malloc((size+1)*sizeof(int))) == NULL) return 1;
+      copy_arr = (int *) malloc((size+1)*sizeof(int));
+      msd_arr = (int *) malloc((size+1)*sizeof(int));
+      if (copy_arr == NULL || msd_arr == NULL) {
+        free(arr);
+        free(copy_arr);
+        free(msd_arr);
+        return 1;
+      }
+      fill_input(arr, size, (enum input_kind) kind);
+      for (size_t j = 0; kind == RANDOM && j < size; ++j) arr[j] -= RAND_MAX/2;
+      memcpy(copy_arr, arr, size*sizeof(int));
+      memcpy(msd_arr, arr, size*sizeof(int));
+
+      if (radix_sort(arr, size) || radix_sort_msd(msd_arr, size) || merge_sort(copy_arr, size)) {
+        printf("Error while executing radix sort:(\n");
+        return 1;
+      }
+      n_pass += eq_arr(arr, copy_arr, size) + eq_arr(msd_arr, copy_arr, size);
+
+      free(arr);
+      free(copy_arr);
+      free(msd_arr);
+    }
+
+    printf("%d/%d radix sort pass for %s input\n", n_pass, n_tests, input_name[kind]);
+  }
+
+  n_pass = 0;
+  for (int i = 0; i < N_TESTS; ++i) {
+    int res = check_radix_i64((size_t) 100000 + (size_t) i);
+
+    if (res < 0) return 1;
+    n_pass += res;
+  }
+  printf("%d/%d int64 radix sort pass\n", n_pass, N_TESTS);
+
+  for (size = PAR_SORT_MIN - 1; size < ((size_t) 2000000); size = size*5 + 3) {
+    size_t n_threads[] = { 2, 3, 4, 7, 16 };
+
+    n_pass = 0;
+    for (size_t i = 0; i < sizeof(n_threads)/sizeof(n_threads[0]); ++i) {
+      int res = check_merge_sort_parallel(size, n_threads[i]);
+
+      if (res < 0) return 1;
+      n_pass += res;
+    }
+
+    printf("%d/%zu parallel sort pass for array of size %zu\n", n_pass,
+           sizeof(n_threads)/sizeof(n_threads[0]), size);
+  }
+
   return 0;
 }
 
@@ -0,0 +1,176 @@
+#include <limits.h>  // INT_MAX
+#include <string.h>  // memcpy()
+#include "partition.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define HAVE_AVX2_KERNEL
+#include <immintrin.h>
+#include <pthread.h>
+#endif
+
+size_t partition_int_scalar(int *arr, size_t n, int pivot)
+{
+  size_t i = 0;
+  int val;
+
+  // Cyclic Lomuto: every element is swapped, only i depends on the compare
+  for (size_t j = ((size_t) 0); j < n; ++j) {
+    val = arr[j];
+    arr[j] = arr[i];
+    arr[i] = val;
+    i += (size_t) (val < pivot);
+  }
+
+  return i;
+}
+
+#ifdef HAVE_AVX2_KERNEL
+/* START: AVX2 partition */
+
+/* perm_table[mask] moves the lanes whose bit is set in mask to the
+   front, in order, and the other lanes after them.
+*/
+static int perm_table[256][8];
+static int has_avx2;
+static pthread_once_t avx2_once = PTHREAD_ONCE_INIT;
+
+static void avx2_init(void)
+{
+  for (int mask = 0; mask < 256; ++mask) {
+    int j = 0;
+
+    for (int i = 0; i < 8; ++i)
+      if (mask & (1 << i)) perm_table[mask][j++] = i;
+    for (int i = 0; i < 8; ++i)
+      if (!(mask & (1 << i))) perm_table[mask][j++] = i;
+  }
+
+  __builtin_cpu_init();
+  has_avx2 = __builtin_cpu_supports("avx2");
+}
+
+/* Stores the lanes of v below pivot at arr[*wl..] and the others
+   just below arr[*wr]. Both stores write all 8 lanes, so the caller
+   must leave 8 free slots at each end (or a contiguous gap).
+*/
+__attribute__((target("avx2")))
+static inline void partition_vec(int *arr, __m256i v, __m256i pivot_vec, size_t *wl, size_t *wr)
+{
+  int mask = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(pivot_vec, v)));
+  size_t n_less = (size_t) __builtin_popcount(mask);
+  __m256i perm = _mm256_loadu_si256((const __m256i *) perm_table[mask]);
+
+  v = _mm256_permutevar8x32_epi32(v, perm);
+  _mm256_storeu_si256((__m256i *) &arr[*wl], v);
+  _mm256_storeu_si256((__m256i *) &arr[*wr - 8], v);
+  *wl += n_less;
+  *wr -= 8 - n_less;
+}
+
+/* In place partition, 8 ints per step. The first and last vectors
+   are held in registers, which opens 8 free slots at each end;
+   every step reads a vector from the side with less free space,
+   so the two full width stores never hit unread data.
+*/
+__attribute__((target("avx2")))
+static size_t partition_int_avx2(int *arr, size_t n, int pivot)
+{
+  __m256i pivot_vec = _mm256_set1_epi32(pivot);
+  __m256i v_left = _mm256_loadu_si256((const __m256i *) arr);
+  __m256i v_right = _mm256_loadu_si256((const __m256i *) &arr[n-8]);
+  __m256i v;
+  int rest[8];
+  size_t l = 8, r = n-8;   // unread data is arr[l..r)
+  size_t wl = 0, wr = n;   // written data is arr[0..wl) and arr[wr..n)
+  size_t n_rest;
+
+  while (r - l >= 8) {
+    if (l - wl <= wr - r) {
+      v = _mm256_loadu_si256((const __m256i *) &arr[l]);
+      l += 8;
+    } else {
+      r -= 8;
+      v = _mm256_loadu_si256((const __m256i *) &arr[r]);
+    }
+    partition_vec(arr, v, pivot_vec, &wl, &wr);
+  }
+
+  // Fewer than 8 unread, place them one by one, then the gap
+  // between wl and wr is contiguous and exactly 16 wide
+  n_rest = r - l;
+  memcpy(rest, &arr[l], n_rest*sizeof(int));
+  for (size_t i = ((size_t) 0); i < n_rest; ++i) {
+    if (rest[i] < pivot) arr[wl++] = rest[i];
+    else arr[--wr] = rest[i];
+  }
+
+  partition_vec(arr, v_left, pivot_vec, &wl, &wr);
+  partition_vec(arr, v_right, pivot_vec, &wl, &wr);
+
+  return wl;
+}
+/* END: AVX2 partition */
+#endif
+
+size_t partition_int(int *arr, size_t n, int pivot)
+{
+#ifdef HAVE_AVX2_KERNEL
+  pthread_once(&avx2_once, avx2_init);
+  if (has_avx2 && n >= 16) return partition_int_avx2(arr, n, pivot);
+#endif
+  return partition_int_scalar(arr, n, pivot);
+}
+
+/* START: Quicksort */
+#define QUICK_SORT_SMALL ((size_t) 16)
+
+static void insertion_sort(int *arr, size_t n)
+{
+  for (size_t i = ((size_t) 1); i < n; ++i) {
+    int val = arr[i];
+    size_t j = i;
+
+    for (; j > 0 && arr[j-1] > val; --j)
+      arr[j] = arr[j-1];
+    arr[j] = val;
+  }
+}
+
+static int median3_val(int a, int b, int c)
+{
+  if (a < b) {
+    if (b < c) return b;
+    return a < c ? c : a;
+  }
+  if (a < c) return a;
+  return b < c ? c : b;
+}
+
+void quick_sort(int *arr, size_t n)
+{
+  size_t m, e;
+  int pivot;
+
+  while (n > QUICK_SORT_SMALL) {
+    pivot = median3_val(arr[0], arr[n/2], arr[n-1]);
+    m = partition_int(arr, n, pivot);
+
+    // Few keys below the pivot: split off the keys equal to it,
+    // which also guarantees progress when they are all equal
+    e = m;
+    if (m < n/4) e = (pivot == INT_MAX) ? n : m + partition_int(&arr[m], n-m, pivot+1);
+
+    // Recurse into the smaller side, loop on the larger one
+    if (m < n-e) {
+      quick_sort(arr, m);
+      arr = &arr[e];
+      n -= e;
+    } else {
+      quick_sort(&arr[e], n-e);
+      n = m;
+    }
+  }
+
+  insertion_sort(arr, n);
+}
+/* END: Quicksort */
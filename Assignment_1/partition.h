@@ -0,0 +1,25 @@
+#ifndef __PARTITION_H__
+#define __PARTITION_H__
+
+#include <stdlib.h>
+
+/* Rearranges arr so that arr[0..m) < pivot <= arr[m..n) and
+   returns m. The pivot does not need to be an element of arr.
+
+   Runs the AVX2 kernel (8 ints per step) when the processor
+   supports it, partition_int_scalar() otherwise.
+*/
+size_t partition_int(int *arr, size_t n, int pivot);
+
+/* Portable branchless version of partition_int(). */
+size_t partition_int_scalar(int *arr, size_t n, int pivot);
+
+/* Quicksort built on partition_int(), with a median of 3 pivot and
+   a split of the keys equal to the pivot when the left part comes
+   out small, so duplicates do not degenerate.
+
+   O(n log n) on average, O(n^2) in the worst case.
+*/
+void quick_sort(int *arr, size_t n);
+
+#endif
@@ -0,0 +1,1134 @@
+#include <string.h> // memcpy()
+#include "sort.h"
+#include "util.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define HAVE_AVX2_KERNEL
+#include <immintrin.h>
+#include <pthread.h>
+#endif
+
+// Merges the sorted runs l_arr[0..l_size) and r_arr[0..r_size) into
+// out, taking from the left run on ties so the sort stays stable
+static void merge(const int *l_arr, size_t l_size,
+                  const int *r_arr, size_t r_size, int *out)
+{
+  size_t l_i = 0;
+  size_t r_i = 0;
+  size_t t_i = 0;
+
+  while (l_i < l_size && r_i < r_size)
+    out[t_i++] = (r_arr[r_i] < l_arr[l_i] ? r_arr[r_i++] : l_arr[l_i++]);
+
+  while (l_i < l_size) out[t_i++] = l_arr[l_i++];
+
+  while (r_i < r_size) out[t_i++] = r_arr[r_i++];
+}
+
+// src and dst hold the same n elements on entry, the sorted result is
+// left in dst. Each level sorts the halves of src using dst as scratch
+// and merges them back into dst, so the two buffers swap roles level
+// by level and nothing is copied back after a merge
+static void merge_sort_rec(int *src, int *dst, size_t n)
+{
+  if (n <= 1) return;
+  size_t mid = n/2;
+
+  merge_sort_rec(dst, src, mid);
+  merge_sort_rec(&dst[mid], &src[mid], n-mid);
+  merge(src, mid, &src[mid], n-mid, dst);
+}
+
+// Sorts arr using the caller supplied scratch buffer tmp of n ints,
+// no allocation is made
+void merge_sort_buf(int *arr, int *tmp, size_t n)
+{
+  if (n <= 1) return;
+
+  memcpy(tmp, arr, n*sizeof(int));
+  merge_sort_rec(tmp, arr, n);
+}
+
+int merge_sort(int *arr, size_t n)
+{
+  int *tmp;
+
+  if (n <= 1) return 0;
+  if ((tmp = (int *) malloc(n*sizeof(int))) == NULL) return 1;
+
+  merge_sort_buf(arr, tmp, n);
+  free(tmp);
+
+  return 0;
+}
+
+/* START: Bottom-up merge sort */
+#define NET_RUN  ((size_t) 8)
+#define L1_RUN   (((size_t) 1) << 12) // 16 KiB of ints
+#define L2_RUN   (((size_t) 1) << 16) // 256 KiB of ints
+
+#define CSWAP(a, b) do {                        \
+    int lo_ = (a) < (b) ? (a) : (b);            \
+    int hi_ = (a) < (b) ? (b) : (a);            \
+    (a) = lo_;                                  \
+    (b) = hi_;                                  \
+  } while (0)
+
+// Sorts src[0..8) into dst with the 19 comparator network, min/max
+// compile to conditional moves so there is no branch to mispredict
+static inline void sort8_network(const int *src, int *dst)
+{
+  int a0 = src[0], a1 = src[1], a2 = src[2], a3 = src[3];
+  int a4 = src[4], a5 = src[5], a6 = src[6], a7 = src[7];
+
+  CSWAP(a0, a2); CSWAP(a1, a3); CSWAP(a4, a6); CSWAP(a5, a7);
+  CSWAP(a0, a4); CSWAP(a1, a5); CSWAP(a2, a6); CSWAP(a3, a7);
+  CSWAP(a0, a1); CSWAP(a2, a3); CSWAP(a4, a5); CSWAP(a6, a7);
+  CSWAP(a2, a4); CSWAP(a3, a5);
+  CSWAP(a1, a4); CSWAP(a3, a6);
+  CSWAP(a1, a2); CSWAP(a3, a4); CSWAP(a5, a6);
+
+  dst[0] = a0; dst[1] = a1; dst[2] = a2; dst[3] = a3;
+  dst[4] = a4; dst[5] = a5; dst[6] = a6; dst[7] = a7;
+}
+
+// merge() with the branch on the data replaced by selects. Each
+// step consumes one element, so min(left, right) steps can run
+// without checking either bound
+static void merge_branchless(const int *l_arr, size_t l_size,
+                             const int *r_arr, size_t r_size, int *out)
+{
+  const int *l_end = &l_arr[l_size], *r_end = &r_arr[r_size];
+  size_t steps;
+
+  while ((steps = (size_t) (l_end - l_arr) < (size_t) (r_end - r_arr)
+                  ? (size_t) (l_end - l_arr) : (size_t) (r_end - r_arr)) > 0) {
+    for (; steps > 0; --steps) {
+      int l = *l_arr, r = *r_arr;
+      int take_r = r < l;
+
+      *out++ = take_r ? r : l;
+      r_arr += take_r;
+      l_arr += !take_r;
+    }
+  }
+
+  memcpy(out, l_arr, (size_t) (l_end - l_arr)*sizeof(int));
+  out += l_end - l_arr;
+  memcpy(out, r_arr, (size_t) (r_end - r_arr)*sizeof(int));
+}
+
+// Sorts every NET_RUN elements of src[0..n) into dst, n being a
+// multiple of NET_RUN
+static void sort8_runs(const int *src, int *dst, size_t n)
+{
+  for (size_t r = ((size_t) 0); r < n; r += NET_RUN)
+    sort8_network(&src[r], &dst[r]);
+}
+
+// Kernels of bottom_up_sort(), with the contracts of sort8_runs()
+// and merge()
+typedef void (*runs_fn_t)(const int *src, int *dst, size_t n);
+typedef void (*merge_fn_t)(const int *l_arr, size_t l_size,
+                           const int *r_arr, size_t r_size, int *out);
+
+// One pass merging the adjacent runs of width elements of src[0..n)
+// into dst. A run without a partner, or a pair already in order
+// (presorted, sawtooth or few unique inputs), is copied instead
+static void merge_pass(const int *src, int *dst, size_t n, size_t width, merge_fn_t merge_fn)
+{
+  for (size_t lo = ((size_t) 0); lo < n; lo += 2*width) {
+    size_t mid = lo + width < n ? lo + width : n;
+    size_t hi = mid + width < n ? mid + width : n;
+
+    if (mid == hi || src[mid-1] <= src[mid])
+      memcpy(&dst[lo], &src[lo], (hi-lo)*sizeof(int));
+    else
+      merge_fn(&src[lo], mid-lo, &src[mid], hi-mid, &dst[lo]);
+  }
+}
+
+// Number of doublings taking width from run to at least n
+static size_t n_passes(size_t run, size_t n)
+{
+  size_t p = 0;
+
+  for (; run < n; run *= 2) ++p;
+
+  return p;
+}
+
+/* Runs of NET_RUN elements are sorted by runs_fn, then merged
+   bottom-up with merge_fn, one L1_RUN block at a time while it is in
+   L1, then one L2_RUN chunk at a time while it is in L2, and only
+   then in passes over the whole array. Every pass ping-pongs between
+   arr and tmp; runs_fn writes to whichever buffer makes the last
+   pass land in arr.
+*/
+static void bottom_up_sort(int *arr, int *tmp, size_t n, runs_fn_t runs_fn, merge_fn_t merge_fn)
+{
+  size_t p1 = n_passes(NET_RUN, n < L1_RUN ? n : L1_RUN);
+  size_t p2 = n_passes(L1_RUN, n < L2_RUN ? n : L2_RUN);
+  size_t p3 = n_passes(L2_RUN, n);
+  int *src, *dst, *cur, *oth, *swp;
+
+  if (n <= 1) return;
+
+  src = (p1 + p2 + p3) % 2 ? tmp : arr;
+  dst = (p1 + p2 + p3) % 2 ? arr : tmp;
+
+  for (size_t c = ((size_t) 0); c < n; c += L2_RUN) {
+    size_t c_len = n - c < L2_RUN ? n - c : L2_RUN;
+
+    for (size_t b = c; b < c + c_len; b += L1_RUN) {
+      size_t b_len = c + c_len - b < L1_RUN ? c + c_len - b : L1_RUN;
+      size_t r = b_len - b_len % NET_RUN, i;
+      int *b_src = &src[b], *b_dst = &dst[b];
+
+      runs_fn(&arr[b], b_src, r);
+
+      // Tail shorter than a network: insertion sort into place
+      for (i = r; i < b_len; ++i) {
+        int val = arr[b+i];
+        size_t j = i;
+
+        for (; j > r && val < b_src[j-1]; --j)
+          b_src[j] = b_src[j-1];
+        b_src[j] = val;
+      }
+
+      for (size_t w = NET_RUN, p = 0; p < p1; w *= 2, ++p) {
+        merge_pass(b_src, b_dst, b_len, w, merge_fn);
+        swp = b_src;
+        b_src = b_dst;
+        b_dst = swp;
+      }
+    }
+
+    cur = p1 % 2 ? dst : src;
+    oth = p1 % 2 ? src : dst;
+    for (size_t w = L1_RUN, p = 0; p < p2; w *= 2, ++p) {
+      merge_pass(&cur[c], &oth[c], c_len, w, merge_fn);
+      swp = cur;
+      cur = oth;
+      oth = swp;
+    }
+  }
+
+  cur = (p1 + p2) % 2 ? dst : src;
+  oth = (p1 + p2) % 2 ? src : dst;
+  for (size_t w = L2_RUN, p = 0; p < p3; w *= 2, ++p) {
+    merge_pass(cur, oth, n, w, merge_fn);
+    swp = cur;
+    cur = oth;
+    oth = swp;
+  }
+}
+
+/* Iterative merge_sort_buf(), same contract: sorts arr with the
+   scratch buffer tmp of n ints and no allocation. bottom_up_sort()
+   with the sorting network and the branchless merge.
+*/
+void merge_sort_bottom_up_buf(int *arr, int *tmp, size_t n)
+{
+  bottom_up_sort(arr, tmp, n, sort8_runs, merge_branchless);
+}
+
+int merge_sort_bottom_up(int *arr, size_t n)
+{
+  int *tmp;
+
+  if (n <= 1) return 0;
+  if ((tmp = (int *) malloc(n*sizeof(int))) == NULL) return 1;
+
+  merge_sort_bottom_up_buf(arr, tmp, n);
+  free(tmp);
+
+  return 0;
+}
+
+/* END: Bottom-up merge sort */
+
+/* START: AVX2 bitonic merge sort */
+#ifdef HAVE_AVX2_KERNEL
+static int has_avx2;
+static pthread_once_t avx2_once = PTHREAD_ONCE_INIT;
+
+static void avx2_init(void)
+{
+  __builtin_cpu_init();
+  has_avx2 = __builtin_cpu_supports("avx2");
+}
+
+#define VCSWAP(a, b) do {                       \
+    __m256i lo_ = _mm256_min_epi32((a), (b));   \
+    (b) = _mm256_max_epi32((a), (b));           \
+    (a) = lo_;                                  \
+  } while (0)
+
+// Sorts the bitonic sequence of the 8 lanes of v: compare-exchange
+// lanes 4 apart, then 2, then 1
+__attribute__((target("avx2")))
+static inline __m256i bitonic_sort8(__m256i v)
+{
+  __m256i t;
+
+  t = _mm256_permute2x128_si256(v, v, 0x01);
+  v = _mm256_blend_epi32(_mm256_min_epi32(v, t), _mm256_max_epi32(v, t), 0xF0);
+  t = _mm256_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2));
+  v = _mm256_blend_epi32(_mm256_min_epi32(v, t), _mm256_max_epi32(v, t), 0xCC);
+  t = _mm256_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1));
+  v = _mm256_blend_epi32(_mm256_min_epi32(v, t), _mm256_max_epi32(v, t), 0xAA);
+
+  return v;
+}
+
+// Merges the sorted vectors a and b into the sorted 16 lanes lo, hi.
+// Reversing b makes a, b one bitonic sequence, so one min/max splits
+// it into two bitonic halves with every lane of lo <= every lane of hi
+__attribute__((target("avx2")))
+static inline void bitonic_merge16(__m256i a, __m256i b, __m256i *lo, __m256i *hi)
+{
+  b = _mm256_permutevar8x32_epi32(b, _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0));
+  *lo = bitonic_sort8(_mm256_min_epi32(a, b));
+  *hi = bitonic_sort8(_mm256_max_epi32(a, b));
+}
+
+/* sort8_runs() on 64 ints at a time held in 8 registers: the 19
+   comparator network sorts the 8 columns, and an 8x8 transpose turns
+   the sorted columns into 8 sorted runs.
+*/
+__attribute__((target("avx2")))
+static void sort8_runs_avx2(const int *src, int *dst, size_t n)
+{
+  size_t r = 0;
+
+  for (; r + 64 <= n; r += 64) {
+    __m256i v0 = _mm256_loadu_si256((const __m256i *) &src[r]);
+    __m256i v1 = _mm256_loadu_si256((const __m256i *) &src[r+8]);
+    __m256i v2 = _mm256_loadu_si256((const __m256i *) &src[r+16]);
+    __m256i v3 = _mm256_loadu_si256((const __m256i *) &src[r+24]);
+    __m256i v4 = _mm256_loadu_si256((const __m256i *) &src[r+32]);
+    __m256i v5 = _mm256_loadu_si256((const __m256i *) &src[r+40]);
+    __m256i v6 = _mm256_loadu_si256((const __m256i *) &src[r+48]);
+    __m256i v7 = _mm256_loadu_si256((const __m256i *) &src[r+56]);
+    __m256i t0, t1, t2, t3, t4, t5, t6, t7;
+
+    VCSWAP(v0, v2); VCSWAP(v1, v3); VCSWAP(v4, v6); VCSWAP(v5, v7);
+    VCSWAP(v0, v4); VCSWAP(v1, v5); VCSWAP(v2, v6); VCSWAP(v3, v7);
+    VCSWAP(v0, v1); VCSWAP(v2, v3); VCSWAP(v4, v5); VCSWAP(v6, v7);
+    VCSWAP(v2, v4); VCSWAP(v3, v5);
+    VCSWAP(v1, v4); VCSWAP(v3, v6);
+    VCSWAP(v1, v2); VCSWAP(v3, v4); VCSWAP(v5, v6);
+
+    t0 = _mm256_unpacklo_epi32(v0, v1);
+    t1 = _mm256_unpackhi_epi32(v0, v1);
+    t2 = _mm256_unpacklo_epi32(v2, v3);
+    t3 = _mm256_unpackhi_epi32(v2, v3);
+    t4 = _mm256_unpacklo_epi32(v4, v5);
+    t5 = _mm256_unpackhi_epi32(v4, v5);
+    t6 = _mm256_unpacklo_epi32(v6, v7);
+    t7 = _mm256_unpackhi_epi32(v6, v7);
+    v0 = _mm256_unpacklo_epi64(t0, t2);
+    v1 = _mm256_unpackhi_epi64(t0, t2);
+    v2 = _mm256_unpacklo_epi64(t1, t3);
+    v3 = _mm256_unpackhi_epi64(t1, t3);
+    v4 = _mm256_unpacklo_epi64(t4, t6);
+    v5 = _mm256_unpackhi_epi64(t4, t6);
+    v6 = _mm256_unpacklo_epi64(t5, t7);
+    v7 = _mm256_unpackhi_epi64(t5, t7);
+
+    _mm256_storeu_si256((__m256i *) &dst[r],    _mm256_permute2x128_si256(v0, v4, 0x20));
+    _mm256_storeu_si256((__m256i *) &dst[r+8],  _mm256_permute2x128_si256(v1, v5, 0x20));
+    _mm256_storeu_si256((__m256i *) &dst[r+16], _mm256_permute2x128_si256(v2, v6, 0x20));
+    _mm256_storeu_si256((__m256i *) &dst[r+24], _mm256_permute2x128_si256(v3, v7, 0x20));
+    _mm256_storeu_si256((__m256i *) &dst[r+32], _mm256_permute2x128_si256(v0, v4, 0x31));
+    _mm256_storeu_si256((__m256i *) &dst[r+40], _mm256_permute2x128_si256(v1, v5, 0x31));
+    _mm256_storeu_si256((__m256i *) &dst[r+48], _mm256_permute2x128_si256(v2, v6, 0x31));
+    _mm256_storeu_si256((__m256i *) &dst[r+56], _mm256_permute2x128_si256(v3, v7, 0x31));
+  }
+
+  sort8_runs(&src[r], &dst[r], n - r);
+}
+
+/* merge() 8 elements at a time. The 8 largest elements merged so far
+   stay in a register and are merged by bitonic_merge16() with the
+   next 8 of whichever run has the smaller head; the 8 smallest are
+   stored. The only data dependent choice, once per 8 outputs, is a
+   select. Once a run has fewer than 8 left, the register and that
+   run are merged into a small buffer and the rest is scalar.
+*/
+__attribute__((target("avx2")))
+static void merge_avx2(const int *l_arr, size_t l_size,
+                       const int *r_arr, size_t r_size, int *out)
+{
+  const int *l_end = &l_arr[l_size], *r_end = &r_arr[r_size], *next;
+  int reg[8], buf[16];
+  __m256i lo, hi;
+  int take_r;
+
+  if (l_size < 8 || r_size < 8) {
+    merge_branchless(l_arr, l_size, r_arr, r_size, out);
+    return;
+  }
+
+  bitonic_merge16(_mm256_loadu_si256((const __m256i *) l_arr),
+                  _mm256_loadu_si256((const __m256i *) r_arr), &lo, &hi);
+  _mm256_storeu_si256((__m256i *) out, lo);
+  l_arr += 8;
+  r_arr += 8;
+  out += 8;
+
+  while (l_end - l_arr >= 8 && r_end - r_arr >= 8) {
+    take_r = *r_arr < *l_arr;
+    next = take_r ? r_arr : l_arr;
+    r_arr += 8*take_r;
+    l_arr += 8*!take_r;
+
+    bitonic_merge16(hi, _mm256_loadu_si256((const __m256i *) next), &lo, &hi);
+    _mm256_storeu_si256((__m256i *) out, lo);
+    out += 8;
+  }
+
+  // The register goes to its own buffer, merge_branchless() must not
+  // write over the run it reads
+  _mm256_storeu_si256((__m256i *) reg, hi);
+  if (l_end - l_arr < 8) {
+    merge_branchless(reg, 8, l_arr, (size_t) (l_end - l_arr), buf);
+    merge_branchless(buf, 8 + (size_t) (l_end - l_arr), r_arr, (size_t) (r_end - r_arr), out);
+  } else {
+    merge_branchless(reg, 8, r_arr, (size_t) (r_end - r_arr), buf);
+    merge_branchless(l_arr, (size_t) (l_end - l_arr), buf, 8 + (size_t) (r_end - r_arr), out);
+  }
+}
+#endif
+
+/* merge_sort_bottom_up_buf() with AVX2 kernels: in-register sorting
+   of 64 element blocks into runs of 8 and the bitonic merge_avx2().
+   Falls back to the scalar branchless kernels without AVX2.
+*/
+void merge_sort_bitonic_buf(int *arr, int *tmp, size_t n)
+{
+#ifdef HAVE_AVX2_KERNEL
+  pthread_once(&avx2_once, avx2_init);
+  if (has_avx2) {
+    bottom_up_sort(arr, tmp, n, sort8_runs_avx2, merge_avx2);
+    return;
+  }
+#endif
+  merge_sort_bottom_up_buf(arr, tmp, n);
+}
+
+int merge_sort_bitonic(int *arr, size_t n)
+{
+  int *tmp;
+
+  if (n <= 1) return 0;
+  if ((tmp = (int *) malloc(n*sizeof(int))) == NULL) return 1;
+
+  merge_sort_bitonic_buf(arr, tmp, n);
+  free(tmp);
+
+  return 0;
+}
+
+/* END: AVX2 bitonic merge sort */
+
+/* START: Adaptive merge sort */
+#define MIN_RUN     ((size_t) 32)
+#define MIN_GALLOP  ((size_t) 7)
+#define RUN_STACK   64
+
+typedef struct {
+  size_t start, len;
+  unsigned power;
+} run_t;
+
+// Number of elements of a[0..n) that are <= key (upper bound), found
+// by doubling from the front then binary search, O(log k) for an
+// answer of k
+static size_t gallop_right(int key, const int *a, size_t n)
+{
+  size_t lo = 0, hi = 1;
+
+  while (hi < n && !(key < a[hi-1])) {
+    lo = hi;
+    hi = 2*hi + 1;
+  }
+  if (hi > n) hi = n;
+
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo)/2;
+
+    if (key < a[mid]) hi = mid;
+    else lo = mid + 1;
+  }
+
+  return lo;
+}
+
+// Number of elements of a[0..n) that are < key (lower bound)
+static size_t gallop_left(int key, const int *a, size_t n)
+{
+  size_t lo = 0, hi = 1;
+
+  while (hi < n && a[hi-1] < key) {
+    lo = hi;
+    hi = 2*hi + 1;
+  }
+  if (hi > n) hi = n;
+
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo)/2;
+
+    if (a[mid] < key) lo = mid + 1;
+    else hi = mid;
+  }
+
+  return lo;
+}
+
+/* Stable in place merge of the sorted runs arr[lo..mid) and
+   arr[mid..hi), tmp being scratch of at least mid-lo ints. The
+   prefix of the left run and the suffix of the right run that are
+   already in place are skipped by galloping, then the left run is
+   moved to tmp and merged forward. Once one side wins MIN_GALLOP
+   times in a row, the length of its winning streak is galloped for
+   and copied in one go.
+*/
+static void merge_gallop(int *arr, int *tmp, size_t lo, size_t mid, size_t hi)
+{
+  const int *l, *l_end, *r, *r_end;
+  int *out;
+  size_t l_wins = 0, r_wins = 0, k;
+
+  lo += gallop_right(arr[mid], &arr[lo], mid-lo);
+  if (lo == mid) return;
+  hi = mid + gallop_left(arr[mid-1], &arr[mid], hi-mid);
+
+  memcpy(tmp, &arr[lo], (mid-lo)*sizeof(int));
+  l = tmp;
+  l_end = &tmp[mid-lo];
+  r = &arr[mid];
+  r_end = &arr[hi];
+  out = &arr[lo];
+
+  while (l < l_end && r < r_end) {
+    if (*r < *l) {
+      *out++ = *r++;
+      ++r_wins;
+      l_wins = 0;
+    } else {
+      *out++ = *l++;
+      ++l_wins;
+      r_wins = 0;
+    }
+
+    if (l_wins >= MIN_GALLOP && r < r_end) {
+      k = gallop_right(*r, l, (size_t) (l_end - l));
+      memcpy(out, l, k*sizeof(int));
+      out += k;
+      l += k;
+      l_wins = 0;
+    } else if (r_wins >= MIN_GALLOP && l < l_end) {
+      k = gallop_left(*l, r, (size_t) (r_end - r));
+      memmove(out, r, k*sizeof(int));
+      out += k;
+      r += k;
+      r_wins = 0;
+    }
+  }
+
+  // What is left of the right run is already in place
+  memcpy(out, l, (size_t) (l_end - l)*sizeof(int));
+}
+
+// Length of the run starting at arr[0], a strictly descending run is
+// reversed in place (strictly, so equal keys keep their order)
+static size_t count_run(int *arr, size_t n)
+{
+  size_t i = 1;
+
+  if (n <= 1) return n;
+
+  if (arr[1] < arr[0]) {
+    while (i < n && arr[i] < arr[i-1]) ++i;
+    for (size_t a = 0, b = i-1; a < b; ++a, --b) {
+      int t = arr[a];
+      arr[a] = arr[b];
+      arr[b] = t;
+    }
+  } else {
+    while (i < n && !(arr[i] < arr[i-1])) ++i;
+  }
+
+  return i;
+}
+
+/* Powersort node power of the boundary between the adjacent runs
+   [s1, s1+n1) and [s1+n1, s1+n1+n2) of an array of n elements: the
+   first bit where the binary fractions of the two run midpoints,
+   relative to n, differ. Shallow boundaries get small powers.
+*/
+static unsigned node_power(size_t s1, size_t n1, size_t n2, size_t n)
+{
+  size_t a = 2*s1 + n1, b = a + n1 + n2, two_n = 2*n;
+  unsigned p = 0;
+
+  for (;;) {
+    ++p;
+    a *= 2;
+    b *= 2;
+    if (a >= two_n) {
+      a -= two_n;
+      b -= two_n;
+    } else if (b >= two_n) {
+      return p;
+    }
+  }
+}
+
+/* Adaptive natural merge sort (powersort), same contract as
+   merge_sort_buf(). Ascending and strictly descending runs already
+   in the input are used as they are, runs shorter than MIN_RUN are
+   extended by insertion sort, and runs are merged with merge_gallop()
+   following the powersort stack policy, which is within a few
+   percent of the optimal merge tree for the run lengths. Sorted or
+   reversed input takes a single O(n) scan, concatenations of r
+   sorted segments O(n log r).
+*/
+void merge_sort_adaptive_buf(int *arr, int *tmp, size_t n)
+{
+  run_t stack[RUN_STACK];
+  size_t top = 0, s1 = 0, n1, n2, force;
+  unsigned p;
+
+  if (n <= 1) return;
+
+  n1 = count_run(arr, n);
+  if (n1 < MIN_RUN && n1 < n) {
+    force = n < MIN_RUN ? n : MIN_RUN;
+    for (size_t i = n1; i < force; ++i) {
+      int val = arr[i];
+      size_t j = i;
+
+      for (; j > 0 && val < arr[j-1]; --j)
+        arr[j] = arr[j-1];
+      arr[j] = val;
+    }
+    n1 = force;
+  }
+
+  while (s1 + n1 < n) {
+    size_t s2 = s1 + n1;
+
+    n2 = count_run(&arr[s2], n-s2);
+    if (n2 < MIN_RUN && s2 + n2 < n) {
+      force = n - s2 < MIN_RUN ? n - s2 : MIN_RUN;
+      for (size_t i = s2 + n2; i < s2 + force; ++i) {
+        int val = arr[i];
+        size_t j = i;
+
+        for (; j > s2 && val < arr[j-1]; --j)
+          arr[j] = arr[j-1];
+        arr[j] = val;
+      }
+      n2 = force;
+    }
+
+    p = node_power(s1, n1, n2, n);
+    while (top > 0 && stack[top-1].power > p) {
+      --top;
+      merge_gallop(arr, tmp, stack[top].start, s1, s1+n1);
+      n1 += s1 - stack[top].start;
+      s1 = stack[top].start;
+    }
+
+    // Powers strictly increase up the stack and are at most
+    // log2(n)+1, so the stack cannot overflow
+    stack[top].start = s1;
+    stack[top].len = n1;
+    stack[top].power = p;
+    ++top;
+
+    s1 = s2;
+    n1 = n2;
+  }
+
+  while (top > 0) {
+    --top;
+    merge_gallop(arr, tmp, stack[top].start, s1, s1+n1);
+    n1 += s1 - stack[top].start;
+    s1 = stack[top].start;
+  }
+}
+
+int merge_sort_adaptive(int *arr, size_t n)
+{
+  int *tmp;
+
+  if (n <= 1) return 0;
+  if ((tmp = (int *) malloc(n*sizeof(int))) == NULL) return 1;
+
+  merge_sort_adaptive_buf(arr, tmp, n);
+  free(tmp);
+
+  return 0;
+}
+
+/* END: Adaptive merge sort */
+
+/* START: In-place merge sort */
+#define INPLACE_BUF  ((size_t) 512) // 2 KiB on the stack, whatever n is
+#define INPLACE_RUN  ((size_t) 32)
+
+// Swaps the blocks arr[0..left) and arr[left..n) with three reversals
+static void rotate(int *arr, size_t left, size_t n)
+{
+  size_t a, b;
+  int t;
+
+  for (a = 0, b = left; a + 1 < b; ++a, --b) {
+    t = arr[a]; arr[a] = arr[b-1]; arr[b-1] = t;
+  }
+  for (a = left, b = n; a + 1 < b; ++a, --b) {
+    t = arr[a]; arr[a] = arr[b-1]; arr[b-1] = t;
+  }
+  for (a = 0, b = n; a + 1 < b; ++a, --b) {
+    t = arr[a]; arr[a] = arr[b-1]; arr[b-1] = t;
+  }
+}
+
+/* Stable merge of the sorted runs arr[0..mid) and arr[mid..n) with
+   only the INPLACE_BUF ints of buf. Once the shorter run fits in buf
+   it is moved there and merged back, from the front for a short left
+   run, from the back for a short right one. Otherwise the longer run
+   is cut in half, the other at the matching key (lower bound of the
+   left key, upper bound of the right key, which keeps equal keys in
+   order), the two middle blocks are swapped by a rotation, and both
+   halves are merged the same way: O(n log n) moves at worst, with
+   O(log n) recursion depth.
+*/
+static void merge_inplace(int *arr, size_t mid, size_t n, int *buf)
+{
+  size_t l_cut, r_cut, new_mid, i, j, k, lo, hi;
+
+  while (mid > 0 && mid < n && arr[mid] < arr[mid-1]) {
+    if (mid <= INPLACE_BUF) {
+      memcpy(buf, arr, mid*sizeof(int));
+      for (i = 0, j = mid, k = 0; i < mid && j < n; )
+        arr[k++] = arr[j] < buf[i] ? arr[j++] : buf[i++];
+      while (i < mid) arr[k++] = buf[i++];
+      return;
+    }
+
+    if (n - mid <= INPLACE_BUF) {
+      memcpy(buf, &arr[mid], (n-mid)*sizeof(int));
+      for (i = mid, j = n - mid, k = n; i > 0 && j > 0; )
+        arr[--k] = buf[j-1] < arr[i-1] ? arr[--i] : buf[--j];
+      while (j > 0) arr[--k] = buf[--j];
+      return;
+    }
+
+    if (mid >= n - mid) {
+      l_cut = mid/2;
+      for (lo = mid, hi = n; lo < hi; ) {
+        size_t m = lo + (hi - lo)/2;
+
+        if (arr[m] < arr[l_cut]) lo = m + 1;
+        else hi = m;
+      }
+      r_cut = lo;
+    } else {
+      r_cut = mid + (n - mid)/2;
+      for (lo = 0, hi = mid; lo < hi; ) {
+        size_t m = lo + (hi - lo)/2;
+
+        if (arr[r_cut] < arr[m]) hi = m;
+        else lo = m + 1;
+      }
+      l_cut = lo;
+    }
+
+    rotate(&arr[l_cut], mid - l_cut, r_cut - l_cut);
+    new_mid = l_cut + (r_cut - mid);
+
+    // Recurse into the shorter side, loop on the longer one
+    if (new_mid < n - new_mid) {
+      merge_inplace(arr, l_cut, new_mid, buf);
+      arr = &arr[new_mid];
+      mid = r_cut - new_mid;
+      n -= new_mid;
+    } else {
+      merge_inplace(&arr[new_mid], r_cut - new_mid, n - new_mid, buf);
+      mid = l_cut;
+      n = new_mid;
+    }
+  }
+}
+
+/* Stable bottom-up merge sort for when no n element buffer can be
+   spared: runs of INPLACE_RUN are insertion sorted, then merged
+   pairwise by merge_inplace(). Extra memory is INPLACE_BUF ints on
+   the stack plus O(log n) recursion, independent of n. O(n log^2 n)
+   at worst, close to merge_sort() while merges fit the buffer.
+   Always returns 0, for the (int *arr, size_t n) interface.
+*/
+int merge_sort_inplace(int *arr, size_t n)
+{
+  int buf[INPLACE_BUF];
+
+  for (size_t r = ((size_t) 0); r < n; r += INPLACE_RUN) {
+    size_t end = n - r < INPLACE_RUN ? n : r + INPLACE_RUN;
+
+    for (size_t i = r + 1; i < end; ++i) {
+      int val = arr[i];
+      size_t j = i;
+
+      for (; j > r && val < arr[j-1]; --j)
+        arr[j] = arr[j-1];
+      arr[j] = val;
+    }
+  }
+
+  for (size_t w = INPLACE_RUN; w < n; w *= 2) {
+    for (size_t lo = ((size_t) 0); lo + w < n; lo += 2*w) {
+      size_t hi = lo + 2*w < n ? lo + 2*w : n;
+
+      merge_inplace(&arr[lo], w, hi - lo, buf);
+    }
+  }
+
+  return 0;
+}
+
+/* END: In-place merge sort */
+
+/* START: Radix sort */
+#define RADIX_BITS    8
+#define RADIX_SIZE    (1 << RADIX_BITS)
+#define RADIX64_BITS  11
+#define RADIX64_SIZE  (1 << RADIX64_BITS)
+#define RADIX64_PASSES ((64 + RADIX64_BITS - 1)/RADIX64_BITS)
+#define MSD_SMALL     ((size_t) 64)
+
+// Flipping the sign bit maps signed order onto unsigned order
+#define KEY32(v) ((uint32_t) (v) ^ UINT32_C(0x80000000))
+#define KEY64(v) ((uint64_t) (v) ^ UINT64_C(0x8000000000000000))
+
+/* LSD radix sort, 4 passes of 8 bit digits, with the scratch buffer
+   tmp of n ints. The histograms of all digits are counted in one
+   read of arr, and a pass whose digit is the same for every element
+   is skipped. Stable, O(n), no comparisons.
+*/
+void radix_sort_buf(int *arr, int *tmp, size_t n)
+{
+  size_t count[4][RADIX_SIZE] = {{0}};
+  size_t offset[RADIX_SIZE], sum;
+  int *src = arr, *dst = tmp, *swp;
+  uint32_t key;
+
+  if (n <= 1) return;
+
+  for (size_t i = ((size_t) 0); i < n; ++i) {
+    key = KEY32(arr[i]);
+    ++count[0][key & (RADIX_SIZE-1)];
+    ++count[1][(key >> 8) & (RADIX_SIZE-1)];
+    ++count[2][(key >> 16) & (RADIX_SIZE-1)];
+    ++count[3][key >> 24];
+  }
+
+  for (unsigned d = 0; d < 4; ++d) {
+    unsigned shift = d*RADIX_BITS;
+
+    if (count[d][(KEY32(arr[0]) >> shift) & (RADIX_SIZE-1)] == n) continue;
+
+    sum = 0;
+    for (size_t b = ((size_t) 0); b < RADIX_SIZE; ++b) {
+      offset[b] = sum;
+      sum += count[d][b];
+    }
+    for (size_t i = ((size_t) 0); i < n; ++i)
+      dst[offset[(KEY32(src[i]) >> shift) & (RADIX_SIZE-1)]++] = src[i];
+
+    swp = src;
+    src = dst;
+    dst = swp;
+  }
+
+  if (src != arr) memcpy(arr, src, n*sizeof(int));
+}
+
+int radix_sort(int *arr, size_t n)
+{
+  int *tmp;
+
+  if (n <= 1) return 0;
+  if ((tmp = (int *) malloc(n*sizeof(int))) == NULL) return 1;
+
+  radix_sort_buf(arr, tmp, n);
+  free(tmp);
+
+  return 0;
+}
+
+/* radix_sort_buf() for int64_t keys, 11 bit digits so 6 passes
+   instead of 8. The six histograms take 96 KiB, past L1 but well
+   within L2, where the counting read of arr finds them; each
+   scatter pass only uses one 16 KiB histogram, which fits in L1.
+*/
+void radix_sort_i64_buf(int64_t *arr, int64_t *tmp, size_t n)
+{
+  size_t count[RADIX64_PASSES][RADIX64_SIZE] = {{0}};
+  size_t offset[RADIX64_SIZE], sum;
+  int64_t *src = arr, *dst = tmp, *swp;
+  uint64_t key;
+
+  if (n <= 1) return;
+
+  for (size_t i = ((size_t) 0); i < n; ++i) {
+    key = KEY64(arr[i]);
+    for (unsigned d = 0; d < RADIX64_PASSES; ++d)
+      ++count[d][(key >> (d*RADIX64_BITS)) & (RADIX64_SIZE-1)];
+  }
+
+  for (unsigned d = 0; d < RADIX64_PASSES; ++d) {
+    unsigned shift = d*RADIX64_BITS;
+
+    if (count[d][(KEY64(arr[0]) >> shift) & (RADIX64_SIZE-1)] == n) continue;
+
+    sum = 0;
+    for (size_t b = ((size_t) 0); b < RADIX64_SIZE; ++b) {
+      offset[b] = sum;
+      sum += count[d][b];
+    }
+    for (size_t i = ((size_t) 0); i < n; ++i)
+      dst[offset[(KEY64(src[i]) >> shift) & (RADIX64_SIZE-1)]++] = src[i];
+
+    swp = src;
+    src = dst;
+    dst = swp;
+  }
+
+  if (src != arr) memcpy(arr, src, n*sizeof(int64_t));
+}
+
+int radix_sort_i64(int64_t *arr, size_t n)
+{
+  int64_t *tmp;
+
+  if (n <= 1) return 0;
+  if ((tmp = (int64_t *) malloc(n*sizeof(int64_t))) == NULL) return 1;
+
+  radix_sort_i64_buf(arr, tmp, n);
+  free(tmp);
+
+  return 0;
+}
+
+/* American flag sort of arr on the digit at shift and the ones
+   below it: counts the digit, then cycles every element straight
+   into its bucket with swaps, and recurses into each bucket on the
+   next digit. Buckets below MSD_SMALL are insertion sorted.
+*/
+static void american_flag(int *arr, size_t n, unsigned shift)
+{
+  size_t count[RADIX_SIZE] = {0}, next[RADIX_SIZE], end[RADIX_SIZE], sum = 0;
+  size_t d;
+  int val, t;
+
+  if (n <= MSD_SMALL) {
+    for (size_t i = ((size_t) 1); i < n; ++i) {
+      size_t j = i;
+
+      val = arr[i];
+      for (; j > 0 && val < arr[j-1]; --j)
+        arr[j] = arr[j-1];
+      arr[j] = val;
+    }
+    return;
+  }
+
+  for (size_t i = ((size_t) 0); i < n; ++i)
+    ++count[(KEY32(arr[i]) >> shift) & (RADIX_SIZE-1)];
+
+  for (size_t b = ((size_t) 0); b < RADIX_SIZE; ++b) {
+    next[b] = sum;
+    sum += count[b];
+    end[b] = sum;
+  }
+
+  for (size_t b = ((size_t) 0); b < RADIX_SIZE; ++b) {
+    while (next[b] < end[b]) {
+      val = arr[next[b]];
+      while ((d = (KEY32(val) >> shift) & (RADIX_SIZE-1)) != b) {
+        t = arr[next[d]];
+        arr[next[d]++] = val;
+        val = t;
+      }
+      arr[next[b]++] = val;
+    }
+  }
+
+  if (shift == 0) return;
+  for (size_t b = ((size_t) 0), start = 0; b < RADIX_SIZE; start = end[b++])
+    if (end[b] - start > 1) american_flag(&arr[start], end[b] - start, shift - RADIX_BITS);
+}
+
+/* In place MSD radix sort (American flag sort) for runs that cannot
+   spare radix_sort()'s n int buffer: O(1) extra memory besides the
+   3 x 256 counters of each of at most 4 recursion levels. Not stable.
+   Always returns 0, for the (int *arr, size_t n) interface.
+*/
+int radix_sort_msd(int *arr, size_t n)
+{
+  if (n > 1) american_flag(arr, n, 32 - RADIX_BITS);
+
+  return 0;
+}
+
+/* END: Radix sort */
+
+/* START: Parallel merge sort */
+
+typedef struct {
+  int *src, *dst;
+  size_t n, n_threads, t;
+  size_t width;       // merge round: runs of width blocks are paired
+  int copy;           // sort phase: also copy the sorted block to dst
+} par_sort_job_t;
+
+// Start of block b of n_threads equal blocks of n elements
+static inline size_t block_start(size_t n, size_t n_threads, size_t b)
+{
+  return n*b/n_threads;
+}
+
+/* Co-rank (merge path split): the number i of elements taken from
+   a, with k-i from b, among the first k outputs of the stable merge
+   of a[0..m) and b[0..nb). Ties go to a, like merge(). Binary search,
+   O(log min(m, nb)).
+*/
+static size_t co_rank(size_t k, const int *a, size_t m, const int *b, size_t nb)
+{
+  size_t lo = k > nb ? k - nb : 0;
+  size_t hi = k < m ? k : m;
+
+  while (lo < hi) {
+    size_t i = lo + (hi - lo)/2;
+    size_t j = k - i;
+
+    // a[i] <= b[j-1] means a[i] is output before b[j-1], take more of a
+    if (j > 0 && !(b[j-1] < a[i])) lo = i + 1;
+    else hi = i;
+  }
+
+  return lo;
+}
+
+/* Sort phase: thread t sorts its block. Merge round: the output is
+   cut into n_threads equal slices and thread t produces slice t of
+   whichever pairs of runs it overlaps, finding where its slice
+   starts and ends in both runs with co_rank(), so every thread does
+   the same amount of merging in every round, the last one included.
+*/
+static void *par_sort_job(void *arg)
+{
+  par_sort_job_t *job = (par_sort_job_t *) arg;
+  size_t n = job->n, n_threads = job->n_threads;
+  size_t lo, hi, pair, l_i, r_i, l_end, r_end;
+  size_t l_start, r_start, p_end, o_lo, o_hi;
+
+  if (job->width == 0) {
+    lo = block_start(n, n_threads, job->t);
+    hi = block_start(n, n_threads, job->t+1);
+    merge_sort_buf(&job->src[lo], &job->dst[lo], hi-lo);
+    if (job->copy) memcpy(&job->dst[lo], &job->src[lo], (hi-lo)*sizeof(int));
+    return NULL;
+  }
+
+  lo = block_start(n, n_threads, job->t);
+  hi = block_start(n, n_threads, job->t+1);
+  for (pair = (job->t/(2*job->width))*2*job->width; pair < n_threads; pair += 2*job->width) {
+    l_start = block_start(n, n_threads, pair);
+    r_start = block_start(n, n_threads, pair + job->width < n_threads ? pair + job->width : n_threads);
+    p_end = block_start(n, n_threads, pair + 2*job->width < n_threads ? pair + 2*job->width : n_threads);
+    if (l_start >= hi) break;
+
+    o_lo = lo > l_start ? lo - l_start : 0;
+    o_hi = (hi < p_end ? hi : p_end) - l_start;
+    l_i = co_rank(o_lo, &job->src[l_start], r_start-l_start, &job->src[r_start], p_end-r_start);
+    l_end = co_rank(o_hi, &job->src[l_start], r_start-l_start, &job->src[r_start], p_end-r_start);
+    r_i = o_lo - l_i;
+    r_end = o_hi - l_end;
+
+    merge(&job->src[l_start+l_i], l_end-l_i, &job->src[r_start+r_i], r_end-r_i,
+          &job->dst[l_start+o_lo]);
+  }
+
+  return NULL;
+}
+
+/* Multi-threaded merge_sort(), same contract. The array is cut into
+   n_threads blocks sorted concurrently with merge_sort_buf(), then
+   ceil(log2 n_threads) rounds merge pairs of runs, each round split
+   evenly over all threads by co-rank, ping-ponging between arr and
+   one scratch buffer like merge_sort_buf(). Blocks have equal size,
+   so a static split keeps every thread busy without a task queue.
+
+   Returns 1 if the scratch buffer cannot be allocated, 0 otherwise.
+   Arrays below PAR_SORT_MIN use the sequential merge_sort().
+*/
+int merge_sort_parallel(int *arr, size_t n, size_t n_threads)
+{
+  par_sort_job_t *jobs;
+  int *tmp, *src, *dst, *swp;
+  size_t rounds = 0;
+
+  if (n_threads == 0) n_threads = 1;
+  if (n < PAR_SORT_MIN || n_threads == 1) return merge_sort(arr, n);
+
+  tmp = (int *) malloc(n*sizeof(int));
+  jobs = (par_sort_job_t *) malloc(n_threads*sizeof(par_sort_job_t));
+  if (tmp == NULL || jobs == NULL) {
+    free(tmp);
+    free(jobs);
+    return 1;
+  }
+
+  // An odd number of rounds ends in tmp, so start them from there
+  for (size_t w = ((size_t) 1); w < n_threads; w *= 2) ++rounds;
+  src = rounds % 2 ? tmp : arr;
+  dst = rounds % 2 ? arr : tmp;
+
+  for (size_t t = ((size_t) 0); t < n_threads; ++t) {
+    jobs[t].src = arr;
+    jobs[t].dst = tmp;
+    jobs[t].n = n;
+    jobs[t].n_threads = n_threads;
+    jobs[t].t = t;
+    jobs[t].width = 0;
+    jobs[t].copy = (int) (rounds % 2);
+  }
+  parallel_run(par_sort_job, jobs, sizeof(par_sort_job_t), n_threads);
+
+  for (size_t w = ((size_t) 1); w < n_threads; w *= 2) {
+    for (size_t t = ((size_t) 0); t < n_threads; ++t) {
+      jobs[t].src = src;
+      jobs[t].dst = dst;
+      jobs[t].width = w;
+    }
+    parallel_run(par_sort_job, jobs, sizeof(par_sort_job_t), n_threads);
+
+    swp = src;
+    src = dst;
+    dst = swp;
+  }
+
+  free(tmp);
+  free(jobs);
+
+  return 0;
+}
+
+/* END: Parallel merge sort */
@@ -0,0 +1,64 @@
+#ifndef __SORT_H__
+#define __SORT_H__
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/* Sort engines for int arrays. Each sorts arr[0..n) in ascending
+   order; the int returning ones allocate their own scratch space and
+   return 1 if that fails, 0 otherwise, and the _buf variants take a
+   caller supplied scratch buffer of n elements and never allocate.
+*/
+
+/* Top-down merge sort, ping-ponging between arr and the scratch
+   buffer level by level. Stable.
+*/
+int merge_sort(int *arr, size_t n);
+void merge_sort_buf(int *arr, int *tmp, size_t n);
+
+/* Iterative merge sort: sorting networks on runs of 8, then merges
+   blocked for L1 and L2. Pairs of runs already in order are copied
+   rather than merged, so presorted input costs one copy per pass.
+   The merges are branchless, which wins on random input but loses
+   to merge_sort() when long runs of equal keys would predict well
+   (about 1.4x slower on few unique values). Stable.
+*/
+int merge_sort_bottom_up(int *arr, size_t n);
+void merge_sort_bottom_up_buf(int *arr, int *tmp, size_t n);
+
+/* merge_sort_bottom_up() with AVX2 in-register sorting and bitonic
+   merge kernels, when the processor supports them.
+*/
+int merge_sort_bitonic(int *arr, size_t n);
+void merge_sort_bitonic_buf(int *arr, int *tmp, size_t n);
+
+/* Natural merge sort (powersort) with galloping merges, O(n) on
+   sorted or reversed input. Stable.
+*/
+int merge_sort_adaptive(int *arr, size_t n);
+void merge_sort_adaptive_buf(int *arr, int *tmp, size_t n);
+
+/* Stable merge sort using a fixed 2 KiB stack buffer instead of an
+   n element one, merging by rotations beyond that. O(n log^2 n) at
+   worst. Always returns 0.
+*/
+int merge_sort_inplace(int *arr, size_t n);
+
+/* Arrays below PAR_SORT_MIN are sorted by merge_sort(). */
+#define PAR_SORT_MIN  (((size_t) 1) << 16)
+
+/* Multi-threaded merge_sort() on n_threads threads. */
+int merge_sort_parallel(int *arr, size_t n, size_t n_threads);
+
+/* LSD radix sort, 8 bit digits (11 bit for int64_t). Stable. */
+int radix_sort(int *arr, size_t n);
+void radix_sort_buf(int *arr, int *tmp, size_t n);
+int radix_sort_i64(int64_t *arr, size_t n);
+void radix_sort_i64_buf(int64_t *arr, int64_t *tmp, size_t n);
+
+/* In place MSD radix sort (American flag sort), no scratch buffer.
+   Not stable, always returns 0.
+*/
+int radix_sort_msd(int *arr, size_t n);
+
+#endif
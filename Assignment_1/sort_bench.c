@@ -0,0 +1,241 @@
+#include <stdio.h>  // printf()
+#include <stdlib.h> // qsort(), malloc(), free(), strtod()
+#include <string.h> // memcpy(), strcmp()
+#include "sort.h"
+#include "util.h"
+
+#define MIN_REPS       3
+#define MAX_REPS       1000
+#define REP_ELEMENTS   ((size_t) 10000000) // per measurement, sets the reps
+#define ZIPF_VALUES    (((size_t) 1) << 16)
+
+/* START: Engines */
+static int cmp_int(const void *a, const void *b)
+{
+  int x = *((const int *) a), y = *((const int *) b);
+
+  return (x > y) - (x < y);
+}
+
+static int qsort_engine(int *arr, size_t n)
+{
+  qsort(arr, n, sizeof(int), cmp_int);
+
+  return 0;
+}
+
+static int parallel_engine(int *arr, size_t n)
+{
+  return merge_sort_parallel(arr, n, n_cpus());
+}
+
+typedef struct {
+  const char *name;
+  int (*sort)(int *arr, size_t n);
+} engine_t;
+
+static const engine_t engines[] = {
+  { "qsort", qsort_engine },
+  { "merge_sort", merge_sort },
+  { "merge_sort_bottom_up", merge_sort_bottom_up },
+  { "merge_sort_bitonic", merge_sort_bitonic },
+  { "merge_sort_adaptive", merge_sort_adaptive },
+  { "merge_sort_inplace", merge_sort_inplace },
+  { "merge_sort_parallel", parallel_engine },
+  { "radix_sort", radix_sort },
+  { "radix_sort_msd", radix_sort_msd },
+};
+#define N_ENGINES (sizeof(engines)/sizeof(engines[0]))
+/* END: Engines */
+
+/* START: Input distributions */
+enum dist { RANDOM, SORTED, REVERSE, SAWTOOTH, FEW_UNIQUE, ZIPF };
+static const char *dist_name[] = { "random", "sorted", "reverse", "sawtooth", "few_unique", "zipf" };
+#define N_DISTS 6
+
+static uint64_t xorshift64(uint64_t *state)
+{
+  *state ^= *state << 13;
+  *state ^= *state >> 7;
+  *state ^= *state << 17;
+
+  return *state;
+}
+
+/* Zipf (s = 1) over ZIPF_VALUES values by inverting the cumulative
+   weights: value v is drawn with probability proportional to 1/(v+1).
+*/
+static void fill_zipf(int *arr, size_t n, uint64_t *state)
+{
+  double *cdf = (double *) malloc(ZIPF_VALUES*sizeof(double));
+  double sum = 0.0, u;
+
+  if (cdf == NULL) {
+    for (size_t i = 0; i < n; ++i) arr[i] = 0;
+    return;
+  }
+
+  for (size_t v = 0; v < ZIPF_VALUES; ++v) cdf[v] = (sum += 1.0/(double) (v+1));
+
+  for (size_t i = 0; i < n; ++i) {
+    size_t lo = 0, hi = ZIPF_VALUES - 1;
+
+    u = (double) (xorshift64(state) >> 11)*(1.0/9007199254740992.0)*sum;
+    while (lo < hi) {
+      size_t mid = lo + (hi - lo)/2;
+
+      if (cdf[mid] < u) lo = mid + 1;
+      else hi = mid;
+    }
+    // Scatter the ranks so frequent values are not the small ones
+    arr[i] = (int) (uint32_t) (lo*UINT64_C(2654435761));
+  }
+
+  free(cdf);
+}
+
+static void fill_dist(int *arr, size_t n, enum dist dist, uint64_t seed)
+{
+  uint64_t state = seed | 1;
+  size_t tooth = n/16 + 1;
+
+  switch (dist) {
+  case RANDOM:
+    for (size_t i = 0; i < n; ++i) arr[i] = (int) (uint32_t) xorshift64(&state);
+    break;
+  case SORTED:
+    for (size_t i = 0; i < n; ++i) arr[i] = (int) (i - n/2);
+    break;
+  case REVERSE:
+    for (size_t i = 0; i < n; ++i) arr[i] = (int) (n/2 - i);
+    break;
+  case SAWTOOTH:
+    for (size_t i = 0; i < n; ++i) arr[i] = (int) (i % tooth);
+    break;
+  case FEW_UNIQUE:
+    for (size_t i = 0; i < n; ++i) arr[i] = (int) (xorshift64(&state) % 16);
+    break;
+  case ZIPF:
+    fill_zipf(arr, n, &state);
+    break;
+  }
+}
+/* END: Input distributions */
+
+/* START: Measurement */
+typedef struct {
+  size_t reps;
+  double min_ns, median_ns;  // per element
+  double melems_per_s;       // at the median
+  int sorted;
+} result_t;
+
+static int cmp_double(const void *a, const void *b)
+{
+  double x = *((const double *) a), y = *((const double *) b);
+
+  return (x > y) - (x < y);
+}
+
+static int is_sorted(const int *arr, size_t n)
+{
+  for (size_t i = 1; i < n; ++i)
+    if (arr[i] < arr[i-1]) return 0;
+
+  return 1;
+}
+
+/* One warmup run, then enough timed runs to sort about REP_ELEMENTS
+   elements (between MIN_REPS and MAX_REPS), each on a fresh copy of
+   input. Returns 1 if the engine failed.
+*/
+static int measure(const engine_t *engine, const int *input, int *work, size_t n, result_t *res)
+{
+  double times[MAX_REPS], t;
+
+  res->reps = REP_ELEMENTS/n;
+  if (res->reps < MIN_REPS) res->reps = MIN_REPS;
+  if (res->reps > MAX_REPS) res->reps = MAX_REPS;
+
+  memcpy(work, input, n*sizeof(int));
+  if (engine->sort(work, n)) return 1;
+  res->sorted = is_sorted(work, n);
+
+  for (size_t r = 0; r < res->reps; ++r) {
+    memcpy(work, input, n*sizeof(int));
+    t = wall_time();
+    if (engine->sort(work, n)) return 1;
+    times[r] = wall_time() - t;
+  }
+
+  qsort(times, res->reps, sizeof(double), cmp_double);
+  res->min_ns = times[0]*1e9/(double) n;
+  res->median_ns = times[res->reps/2]*1e9/(double) n;
+  res->melems_per_s = 1e3/res->median_ns;
+
+  return 0;
+}
+/* END: Measurement */
+
+/* Sorting benchmark over every engine of sort.h and qsort(), every
+   input distribution and sizes 10^3, 10^4, ... up to max size.
+
+     sort_bench [csv|json] [max size] [engine name]
+
+   Prints one CSV line or JSON object per (engine, distribution,
+   size) with the repetitions, best and median ns per element, the
+   median throughput and whether the output was sorted. The default
+   max size is 10^6; 10^9 needs about 8 GB.
+*/
+int main(int argc, char **argv)
+{
+  int json = argc > 1 && strcmp(argv[1], "json") == 0;
+  size_t max_size = argc > 2 ? (size_t) strtod(argv[2], NULL) : (size_t) 1000000;
+  const char *only = argc > 3 ? argv[3] : NULL;
+  int *input, *work;
+  result_t res;
+  int first = 1;
+
+  if ((input = (int *) malloc(max_size*sizeof(int))) == NULL) return 1;
+  if ((work = (int *) malloc(max_size*sizeof(int))) == NULL) {
+    free(input);
+    return 1;
+  }
+
+  if (json) printf("[\n");
+  else printf("engine,distribution,size,reps,min_ns_per_elem,median_ns_per_elem,melem_per_s,sorted\n");
+
+  for (size_t n = ((size_t) 1000); n <= max_size; n *= 10) {
+    for (int d = 0; d < N_DISTS; ++d) {
+      fill_dist(input, n, (enum dist) d, (uint64_t) n*N_DISTS + (uint64_t) d);
+
+      for (size_t e = 0; e < N_ENGINES; ++e) {
+        if (only != NULL && strcmp(only, engines[e].name) != 0) continue;
+        if (measure(&engines[e], input, work, n, &res)) {
+          fprintf(stderr, "%s failed on %zu elements\n", engines[e].name, n);
+          continue;
+        }
+
+        if (json) {
+          printf("%s  {\"engine\": \"%s\", \"distribution\": \"%s\", \"size\": %zu, \"reps\": %zu, "
+                 "\"min_ns_per_elem\": %.3f, \"median_ns_per_elem\": %.3f, "
+                 "\"melem_per_s\": %.2f, \"sorted\": %s}",
+                 first ? "" : ",\n", engines[e].name, dist_name[d], n, res.reps,
+                 res.min_ns, res.median_ns, res.melems_per_s, res.sorted ? "true" : "false");
+        } else {
+          printf("%s,%s,%zu,%zu,%.3f,%.3f,%.2f,%d\n", engines[e].name, dist_name[d], n,
+                 res.reps, res.min_ns, res.median_ns, res.melems_per_s, res.sorted);
+        }
+        first = 0;
+        fflush(stdout);
+      }
+    }
+  }
+
+  if (json) printf("\n]\n");
+
+  free(input);
+  free(work);
+
+  return 0;
+}
@@ -0,0 +1,304 @@
+#ifndef __SORT_TYPED_H__
+#define __SORT_TYPED_H__
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Typed selection and sorting for any element type, in the style
+   of FOLD_DEFINE in fold.h. less is a macro (or inline function)
+   taking two elements by value and returning non-zero if the first
+   orders before the second; it is expanded inline, so a struct
+   holding a key and its payload (or row index) is moved as a whole
+   with no boxing and no comparator call.
+
+     SELECT_DEFINE(k_minima_rec, rec64_t, SORT_KEY_LESS)
+     MERGE_SORT_DEFINE(merge_sort_rec, rec64_t, SORT_KEY_LESS)
+     ARGSORT_DEFINE(argsort_f32, float, SORT_LESS)
+
+   SORT_LESS orders integer and floating point types (without NaNs)
+   by value, SORT_KEY_LESS orders structs such as rec64_t by their
+   key member.
+
+   SELECT_DEFINE(name, type, less) defines
+
+     static void name(type *arr, size_t n, size_t k);
+
+   which leaves the k smallest elements in arr[0..k-1], like
+   k_minima(): introselect with median-of-3/ninther pivots, the
+   branchless partition of partition_int_scalar() and a median of
+   medians fallback, O(n) worst case.
+
+   SELECT_DEFINE_PARTITION(name, type, less, partition) is the same
+   with partition(arr, n, pivot) in place of the scalar partition. It
+   must move the elements less than pivot to the front and return how
+   many there are, like partition_int(), with which the int
+   instantiation runs the AVX2 kernel of k_minima().
+
+   MERGE_SORT_DEFINE(name, type, less) defines
+
+     static inline int name(type *arr, size_t n);
+
+   a stable merge sort using one n element scratch buffer, which it
+   ping-pongs with arr like merge_sort(). Returns 1 if the buffer
+   cannot be allocated, 0 otherwise.
+   It also defines
+
+     static inline void name##_buf(type *arr, type *tmp, size_t n);
+
+   which sorts with the caller's scratch buffer of n elements instead,
+   like merge_sort_buf().
+
+   ARGSORT_DEFINE(name, type, less) defines
+
+     static int name(const type *keys, size_t *perm, size_t n);
+
+   which writes to perm the permutation that stably sorts keys,
+   keys[perm[0]] <= keys[perm[1]] <= ... Returns 1 if out of memory.
+*/
+
+#define SORT_TYPED_SMALL ((size_t) 16)
+
+#define SORT_LESS(a, b)      ((a) < (b))
+#define SORT_KEY_LESS(a, b)  ((a).key < (b).key)
+
+// A 64-bit key with its payload (or row index)
+typedef struct {
+  int64_t key;
+  uint64_t payload;
+} rec64_t;
+
+#define SELECT_DEFINE(name, type, less)                                   \
+  SELECT_DEFINE_PARTITION(name, type, less, name##_partition_less)
+
+#define SELECT_DEFINE_PARTITION(name, type, less, partition)              \
+static inline void name##_swap(type *a, type *b)                          \
+{                                                                         \
+  type t = *a;                                                            \
+  *a = *b;                                                                \
+  *b = t;                                                                 \
+}                                                                         \
+                                                                          \
+static void name##_insertion_sort(type *arr, size_t n)                    \
+{                                                                         \
+  for (size_t i = ((size_t) 1); i < n; ++i) {                             \
+    type val = arr[i];                                                    \
+    size_t j = i;                                                         \
+                                                                          \
+    for (; j > 0 && less(val, arr[j-1]); --j)                             \
+      arr[j] = arr[j-1];                                                  \
+    arr[j] = val;                                                         \
+  }                                                                       \
+}                                                                         \
+                                                                          \
+static size_t name##_median3(const type *arr, size_t a, size_t b, size_t c) \
+{                                                                         \
+  if (less(arr[a], arr[b])) {                                             \
+    if (less(arr[b], arr[c])) return b;                                   \
+    return less(arr[a], arr[c]) ? c : a;                                  \
+  }                                                                       \
+  if (less(arr[a], arr[c])) return a;                                     \
+  return less(arr[b], arr[c]) ? c : b;                                    \
+}                                                                         \
+                                                                          \
+static size_t name##_choose_pivot(const type *arr, size_t n)              \
+{                                                                         \
+  size_t mid = n/2;                                                       \
+  size_t step = n/8;                                                      \
+                                                                          \
+  if (n < 128) return name##_median3(arr, 0, mid, n-1);                   \
+  return name##_median3(arr,                                              \
+    name##_median3(arr, 0, step, 2*step),                                 \
+    name##_median3(arr, mid-step, mid, mid+step),                         \
+    name##_median3(arr, n-1-2*step, n-1-step, n-1));                      \
+}                                                                         \
+                                                                          \
+/* Branchless cyclic Lomuto: moves the elements below the pivot */       \
+/* to the front and returns how many there are */                        \
+static inline size_t name##_partition_less(type *arr, size_t n, type pivot) \
+{                                                                         \
+  size_t i = 0;                                                           \
+                                                                          \
+  for (size_t j = ((size_t) 0); j < n; ++j) {                             \
+    type val = arr[j];                                                    \
+    arr[j] = arr[i];                                                      \
+    arr[i] = val;                                                         \
+    i += (size_t) (less(val, pivot) ? 1 : 0);                             \
+  }                                                                       \
+                                                                          \
+  return i;                                                               \
+}                                                                         \
+                                                                          \
+/* Same, for the elements not above the pivot */                         \
+static size_t name##_partition_not_greater(type *arr, size_t n, type pivot) \
+{                                                                         \
+  size_t i = 0;                                                           \
+                                                                          \
+  for (size_t j = ((size_t) 0); j < n; ++j) {                             \
+    type val = arr[j];                                                    \
+    arr[j] = arr[i];                                                      \
+    arr[i] = val;                                                         \
+    i += (size_t) (less(pivot, val) ? 0 : 1);                             \
+  }                                                                       \
+                                                                          \
+  return i;                                                               \
+}                                                                         \
+                                                                          \
+static void name##_select_rank(type *arr, size_t n, size_t k, size_t depth); \
+                                                                          \
+static size_t name##_median_of_medians(type *arr, size_t n)               \
+{                                                                         \
+  size_t m = 0;                                                           \
+                                                                          \
+  if (n <= 5) {                                                           \
+    name##_insertion_sort(arr, n);                                        \
+    return n/2;                                                           \
+  }                                                                       \
+                                                                          \
+  for (size_t i = ((size_t) 0); i + 5 <= n; i += 5) {                     \
+    name##_insertion_sort(&arr[i], 5);                                    \
+    name##_swap(&arr[m++], &arr[i+2]);                                    \
+  }                                                                       \
+  name##_select_rank(arr, m, m/2, 0);                                     \
+                                                                          \
+  return m/2;                                                             \
+}                                                                         \
+                                                                          \
+static void name##_select_rank(type *arr, size_t n, size_t k, size_t depth) \
+{                                                                         \
+  size_t p, e;                                                            \
+  type pivot;                                                             \
+                                                                          \
+  while (n > SORT_TYPED_SMALL) {                                          \
+    if (depth == 0) {                                                     \
+      p = name##_median_of_medians(arr, n);                               \
+    } else {                                                              \
+      p = name##_choose_pivot(arr, n);                                    \
+      --depth;                                                            \
+    }                                                                     \
+                                                                          \
+    pivot = arr[p];                                                       \
+    p = partition(arr, n, pivot);                                         \
+    if (k < p) {                                                          \
+      n = p;                                                              \
+      continue;                                                           \
+    }                                                                     \
+                                                                          \
+    /* Split off the keys equal to the pivot if few are below it */      \
+    e = p;                                                                \
+    if (p < n/4) e = p + name##_partition_not_greater(&arr[p], n-p, pivot); \
+    if (k < e) return;                                                    \
+                                                                          \
+    arr = &arr[e];                                                        \
+    n -= e;                                                               \
+    k -= e;                                                               \
+  }                                                                       \
+                                                                          \
+  name##_insertion_sort(arr, n);                                          \
+}                                                                         \
+                                                                          \
+static void name(type *arr, size_t n, size_t k)                           \
+{                                                                         \
+  size_t depth = 0;                                                       \
+                                                                          \
+  if (n <= 1 || k == 0) return;                                           \
+  if (k > n) k = n;                                                       \
+                                                                          \
+  for (size_t m = n; m > 1; m >>= 1) depth += 2;                          \
+  name##_select_rank(arr, n, k-1, depth);                                 \
+}
+
+#define MERGE_SORT_DEFINE(name, type, less)                               \
+static void name##_insertion_sort(type *arr, size_t n)                    \
+{                                                                         \
+  for (size_t i = ((size_t) 1); i < n; ++i) {                             \
+    type val = arr[i];                                                    \
+    size_t j = i;                                                         \
+                                                                          \
+    for (; j > 0 && less(val, arr[j-1]); --j)                             \
+      arr[j] = arr[j-1];                                                  \
+    arr[j] = val;                                                         \
+  }                                                                       \
+}                                                                         \
+                                                                          \
+/* src and dst hold the same n elements, the sorted result is left */   \
+/* in dst; the buffers swap roles level by level, like merge_sort() */  \
+static void name##_rec(type *src, type *dst, size_t n)                    \
+{                                                                         \
+  size_t mid = n/2;                                                       \
+  size_t l_i = 0, r_i = mid, t_i = 0;                                     \
+                                                                          \
+  if (n <= SORT_TYPED_SMALL) {                                            \
+    name##_insertion_sort(dst, n);                                        \
+    return;                                                               \
+  }                                                                       \
+                                                                          \
+  name##_rec(dst, src, mid);                                              \
+  name##_rec(&dst[mid], &src[mid], n-mid);                                \
+                                                                          \
+  while (l_i < mid && r_i < n)                                            \
+    dst[t_i++] = less(src[r_i], src[l_i]) ? src[r_i++] : src[l_i++];      \
+  while (l_i < mid) dst[t_i++] = src[l_i++];                              \
+  while (r_i < n) dst[t_i++] = src[r_i++];                                \
+}                                                                         \
+                                                                          \
+static inline void name##_buf(type *arr, type *tmp, size_t n)             \
+{                                                                         \
+  if (n <= 1) return;                                                     \
+                                                                          \
+  memcpy(tmp, arr, n*sizeof(type));                                       \
+  name##_rec(tmp, arr, n);                                                \
+}                                                                         \
+                                                                          \
+static inline int name(type *arr, size_t n)                               \
+{                                                                         \
+  type *tmp;                                                              \
+                                                                          \
+  if (n <= 1) return 0;                                                   \
+  if ((tmp = (type *) malloc(n*sizeof(type))) == NULL) return 1;          \
+                                                                          \
+  name##_buf(arr, tmp, n);                                                \
+  free(tmp);                                                              \
+                                                                          \
+  return 0;                                                               \
+}
+
+#define ARGSORT_DEFINE(name, type, less)                                  \
+typedef struct {                                                          \
+  type key;                                                               \
+  size_t idx;                                                             \
+} name##_pair_t;                                                          \
+                                                                          \
+static inline int name##_pair_less(name##_pair_t a, name##_pair_t b)      \
+{                                                                         \
+  return less(a.key, b.key);                                              \
+}                                                                         \
+                                                                          \
+MERGE_SORT_DEFINE(name##_sort_pairs, name##_pair_t, name##_pair_less)     \
+                                                                          \
+static int name(const type *keys, size_t *perm, size_t n)                 \
+{                                                                         \
+  name##_pair_t *pairs;                                                   \
+                                                                          \
+  if ((pairs = (name##_pair_t *) malloc((n > 0 ? n : 1)*sizeof(name##_pair_t))) == NULL) \
+    return 1;                                                             \
+                                                                          \
+  for (size_t i = ((size_t) 0); i < n; ++i) {                             \
+    pairs[i].key = keys[i];                                               \
+    pairs[i].idx = i;                                                     \
+  }                                                                       \
+                                                                          \
+  if (name##_sort_pairs(pairs, n)) {                                      \
+    free(pairs);                                                          \
+    return 1;                                                             \
+  }                                                                       \
+                                                                          \
+  for (size_t i = ((size_t) 0); i < n; ++i)                               \
+    perm[i] = pairs[i].idx;                                               \
+                                                                          \
+  free(pairs);                                                            \
+                                                                          \
+  return 0;                                                               \
+}
+
+#endif
@@ -1,5 +1,7 @@
+#include <pthread.h>
 #include <stdio.h>  // printf()
 #include <time.h>   // time()
+#include <unistd.h> // sysconf()
 #include "util.h"
 
 void print_nums(const int *arr, const size_t n)
@@ -46,6 +48,51 @@ void sub10(uint32_t *h, uint32_t *l, uint32_t a, const uint32_t b)
   *l = a - b;
 }
 
+void mul1e9(uint32_t *h, uint32_t *l, const uint32_t a, const uint32_t b)
+{
+  uint64_t t = ((uint64_t) a) * b;
+
+  *h = (uint32_t) (t / ((uint64_t) 1000000000));
+  *l = (uint32_t) (t % ((uint64_t) 1000000000));
+}
+
+void add1e9(uint32_t *h, uint32_t *l, const uint32_t a, const uint32_t b)
+{
+  *l = a + b;
+  *h = *l / ((uint32_t) 1000000000);
+  *l = *l % ((uint32_t) 1000000000);
+}
+
+void sub1e9(uint32_t *h, uint32_t *l, uint32_t a, const uint32_t b)
+{
+  *h = ((uint32_t) 0);
+  if (a < b) {
+    a += ((uint32_t) 1000000000);
+    *h = ((uint32_t) 1);
+  }
+  *l = a - b;
+}
+
+void mul2to32(uint32_t *h, uint32_t *l, const uint32_t a, const uint32_t b)
+{
+  uint64_t t = ((uint64_t) a) * b;
+
+  *h = (uint32_t) (t >> 32);
+  *l = (uint32_t) t;
+}
+
+void add2to32(uint32_t *h, uint32_t *l, const uint32_t a, const uint32_t b)
+{
+  *l = a + b;
+  *h = (uint32_t) (*l < a);
+}
+
+void sub2to32(uint32_t *h, uint32_t *l, uint32_t a, const uint32_t b)
+{
+  *h = (uint32_t) (a < b);
+  *l = a - b;
+}
+
 int comp10(const uint32_t *a1, const uint32_t *a2, const size_t n)
 {
   for (size_t i = 0; i < n; ++i) {
@@ -78,3 +125,57 @@ uint32_t *gen_uint_arr(const uint32_t size, const size_t base, const int seed_of
   return nums;
 }
 
+
+double wall_time(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ((double) ts.tv_sec) + ((double) ts.tv_nsec)*1e-9;
+}
+
+size_t n_cpus(void)
+{
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+  return n < 1L ? ((size_t) 1) : ((size_t) n);
+}
+
+int parallel_run(void *(*fn)(void *), void *args, const size_t arg_size, const size_t n_threads)
+{
+  pthread_t *tids;
+  char *blocks = (char *) args;
+  size_t n_started;
+  int ret = 0;
+
+  if (n_threads == ((size_t) 0)) return 0;
+
+  if (n_threads == ((size_t) 1)) {
+    fn(blocks);
+    return 0;
+  }
+
+  if ((tids = (pthread_t *) malloc((n_threads-1)*sizeof(pthread_t))) == NULL) {
+    for (size_t i = ((size_t) 0); i < n_threads; ++i)
+      fn(&blocks[i*arg_size]);
+    return 1;
+  }
+
+  for (n_started = ((size_t) 0); n_started < n_threads-1; ++n_started)
+    if (pthread_create(&tids[n_started], NULL, fn, &blocks[(n_started+1)*arg_size]) != 0) break;
+
+  // Whatever could not be handed off runs here
+  fn(blocks);
+  for (size_t i = n_started+1; i < n_threads; ++i) {
+    fn(&blocks[i*arg_size]);
+    ret = 1;
+  }
+
+  for (size_t i = ((size_t) 0); i < n_started; ++i)
+    pthread_join(tids[i], NULL);
+
+  free(tids);
+
+  return ret;
+}
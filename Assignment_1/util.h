@@ -1,6 +1,7 @@
 #ifndef __UTIL_H__
 #define __UTIL_H__
 
+#include <stdint.h>
 #include <stdlib.h>
 
 void print_nums(const int *arr, const size_t n);
@@ -11,7 +12,35 @@ void add10(uint32_t *h, uint32_t *l, const uint32_t a, const uint32_t b);
 void sub10(uint32_t *h, uint32_t *l, uint32_t a, const uint32_t b);
 int comp10(const uint32_t *a1, const uint32_t *a2, const size_t n);
 
+/* Digit operations of radix 10^9 and 2^32, with the same contract
+   as mul10(), add10() and sub10(). comp10() compares digit arrays
+   of any radix.
+*/
+void mul1e9(uint32_t *h, uint32_t *l, const uint32_t a, const uint32_t b);
+void add1e9(uint32_t *h, uint32_t *l, const uint32_t a, const uint32_t b);
+void sub1e9(uint32_t *h, uint32_t *l, uint32_t a, const uint32_t b);
+void mul2to32(uint32_t *h, uint32_t *l, const uint32_t a, const uint32_t b);
+void add2to32(uint32_t *h, uint32_t *l, const uint32_t a, const uint32_t b);
+void sub2to32(uint32_t *h, uint32_t *l, uint32_t a, const uint32_t b);
+
 void print_uint_nums(const uint32_t *arr, const size_t n);
 uint32_t *gen_uint_arr(const uint32_t size, const size_t base, const int seed_offset);
 
+/* Monotonic wall clock time in seconds, for benchmarks. */
+double wall_time(void);
+
+/* Number of online processors, at least 1. */
+size_t n_cpus(void);
+
+/* Runs fn on n_threads argument blocks of arg_size bytes each,
+   starting at args. Block 0 runs on the calling thread, the
+   others on freshly created threads that are joined before
+   returning.
+
+   Returns 0 on success, 1 if a thread could not be created (the
+   blocks that could not be handed to a thread are run on the
+   calling thread instead, so the work is always done).
+*/
+int parallel_run(void *(*fn)(void *), void *args, const size_t arg_size, const size_t n_threads);
+
 #endif